@@ -23,6 +23,11 @@
 #include <boost/filesystem.hpp>
 #include <stdexcept>
 #include <condition_variable>
+#include <optional>
+#include <csignal>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "AI/MMAI/schema/schema.h"
 #include "ExceptionsCommon.h"
@@ -41,13 +46,14 @@
 #include "lib/logging/CBasicLogConfigurator.h"
 #include "lib/CConsoleHandler.h"
 #include "lib/VCMIDirs.h"
+#include "client/CServerHandler.h"
+#include "GameEngine.h"
+#include "GameInstance.h"
+
 #include "media/CEmptyVideoPlayer.h"
 #include "media/CMusicHandler.h"
 #include "media/CSoundHandler.h"
 #include "media/CVideoHandler.h"
-#include "client/CServerHandler.h"
-#include "GameEngine.h"
-#include "GameInstance.h"
 #include "client/gui/CursorHandler.h"
 #include "client/eventsSDL/InputHandler.h"
 #include "client/render/Graphics.h"
@@ -55,28 +61,28 @@
 #include "client/CPlayerInterface.h"
 #include "client/gui/WindowHandler.h"
 #include "client/mainmenu/CMainMenu.h"
+#include "render/IRenderHandler.h"
+#include "windows/InfoWindows.h"
+#include "windows/CMessage.h"
 
 #include "lib/filesystem/Filesystem.h"
 #include "lib/texts/CGeneralTextHandler.h"
 #include "lib/VCMIDirs.h"
 #include "lib/CConfigHandler.h"
-#include "render/IRenderHandler.h"
 #include "vstd/CLoggerBase.h"
-#include "windows/InfoWindows.h"
-#include "windows/CMessage.h"
 
 static std::optional<std::string> criticalInitializationError;
 std::atomic<bool> headlessQuit = false;
 CBasicLogConfigurator *logConfig;
 CConsoleHandler *console;
 
-bool headless;
-std::mutex mutex_shutdown;
-std::condition_variable cond_shutdown;
-bool flag_shutdown = false;
-
-std::string mapname;
-MMAI::Schema::Baggage * baggage;
+// Process-wide state shared by all sessions
+std::mutex mutex_init;
+std::mutex mutex_game;
+std::once_flag flag_filesystem;
+std::once_flag flag_library;
+std::atomic<ML::Session*> activeSession = nullptr;
+std::unique_ptr<ML::Session> defaultSession;
 
 #ifndef VCMI_BIN_DIR
 #error "VCMI_BIN_DIR compile definition needs to be set"
@@ -109,12 +115,8 @@ void handleFatalError(const std::string & message, bool terminate)
 
 namespace ML {
     void shutdown_vcmi() {
-        auto l = std::lock_guard(mutex_shutdown);
-        cond_shutdown.notify_all();
-        flag_shutdown = true;
-
-        // XXX: start in a thread?
-        GAME->onShutdownRequested(false);
+        if (defaultSession)
+            defaultSession->shutdown();
     }
 
     void validateValue(std::string name, std::string value, std::vector<std::string> values) {
@@ -143,7 +145,7 @@ namespace ML {
         exit(1);
     }
 
-    void validateArguments(InitArgs &a) {
+    void validateArguments(const InitArgs &a) {
         auto wd = boost::filesystem::current_path();
 
         if (a.statsMode != "disabled" && a.statsMode != "red" && a.statsMode != "blue") {
@@ -267,15 +269,15 @@ namespace ML {
         }
     }
 
-    void processArguments(InitArgs &a) {
-        headless = a.headless;
-        baggage = new MMAI::Schema::Baggage;
-        baggage->modelLeft = a.leftModel;
-        baggage->modelRight = a.rightModel;
+    // convert "ai/mymap.vmap" to "maps/ai/mymap.vmap"
+    std::filesystem::path mapPath(const InitArgs &a) {
+        return std::filesystem::path("Maps") / std::filesystem::path(a.mapname);
+    }
 
-        Settings(settings.write({"adventure", "quickCombat"}))->Bool() = headless;
-        Settings(settings.write({"session", "headless"}))->Bool() = headless;
-        Settings(settings.write({"session", "onlyai"}))->Bool() = headless;
+    void processArguments(const InitArgs &a) {
+        Settings(settings.write({"adventure", "quickCombat"}))->Bool() = a.headless;
+        Settings(settings.write({"session", "headless"}))->Bool() = a.headless;
+        Settings(settings.write({"session", "onlyai"}))->Bool() = a.headless;
         Settings(settings.write({"server", "localPort"}))->Integer() = 0;
         Settings(settings.write({"server", "useProcess"}))->Bool() = false;
         Settings(settings.write({"server", "seed"}))->Integer() = a.seed;
@@ -311,21 +313,22 @@ namespace ML {
         // TODO: make configurable
         Settings(settings.write({"general", "lastDifficulty"}))->Integer() = 3;
 
-        // convert to "ai/mymap.vmap" to "maps/ai/mymap.vmap"
-        auto mappath = std::filesystem::path("Maps") / std::filesystem::path(a.mapname);
-        // store "maps/ai/mymap.vmap" into global var
-        mapname = mappath.string();
-
         // Set "lastMap" to prevent some race condition debugStartTest+Menu screen
         // convert to "maps/ai/mymap.vmap" to "maps/ai/mymap"
+        auto mappath = mapPath(a);
         auto lastmap = (mappath.parent_path() / mappath.stem()).string();
         // convert to "maps/ai/mymap" to "MAPS/AI/MYMAP"
         std::transform(lastmap.begin(), lastmap.end(), lastmap.begin(), [](unsigned char c) { return std::toupper(c); });
         Settings(settings.write({"general", "lastMap"}))->String() = lastmap;
 
-        //
-        // Configure logging
-        //
+        Settings(settings.write({"battle", "speedFactor"}))->Integer() = 5;
+        Settings(settings.write({"battle", "rangeLimitHighlightOnHover"}))->Bool() = true;
+        Settings(settings.write({"battle", "stickyHeroInfoWindows"}))->Bool() = false;
+        Settings(settings.write({"logging", "console", "format"}))->String() = "[%t][%n] %l %m";
+        Settings(settings.write({"logging", "console", "coloredOutputEnabled"}))->Bool() = true;
+    }
+
+    void configureLogging(const InitArgs &a) {
         auto getloglevel = [](std::string domain){
             for (auto logger : settings["logging"]["loggers"].Vector())
                 if (logger["domain"].String() == domain)
@@ -362,86 +365,178 @@ namespace ML {
         conflog("mod", loglevelMod);
         conflog("animation", loglevelAnimation);
         conflog("bonus", loglevelBonus);
+
+        logConfig->configure();
     }
 
-    void init_vcmi(InitArgs &a) {
-        // Store original shell workdir (as VCMI will chdir to VCMI_BIN_DIR)
-        // The original workdir is used for loading models specified by relative paths
-        // (then is again changed to VCMI_BIN_DIR to prevent VCMI errors)
-        auto wd = fs::current_path();
+    // Must be called with VCMI_BIN_DIR as workdir
+    void initFilesystem() {
+        std::call_once(flag_filesystem, []() {
+            std::cout.flags(std::ios::unitbuf);
 
-        // chdir needed for VCMI init
-        fs::current_path(fs::path(VCMI_BIN_DIR));
-        std::cout.flags(std::ios::unitbuf);
+            auto callbackFunction = [](std::string buffer, bool calledFromIngameConsole) {};
 
-        auto callbackFunction = [](std::string buffer, bool calledFromIngameConsole) {};
+            // started in start_vcmi() (a thread, see start_vcmi_workers)
+            console = new CConsoleHandler(callbackFunction);
 
-        console = new CConsoleHandler(callbackFunction);
-        console->start();
+            const boost::filesystem::path logPath = VCMIDirs::get().userLogsPath() / "VCMI_Client_log.txt";
+            logConfig = new CBasicLogConfigurator(logPath, console);
+            logConfig->configureDefault();
 
-        const boost::filesystem::path logPath = VCMIDirs::get().userLogsPath() / "VCMI_Client_log.txt";
-        logConfig = new CBasicLogConfigurator(logPath, console);
-        logConfig->configureDefault();
+            // XXX: apparently this needs to be invoked before Settings() stuff
+            LIBRARY = new GameLibrary;
+            LIBRARY->initializeFilesystem(false);
+        });
+    }
 
-        // XXX: apparently this needs to be invoked before Settings() stuff
-        LIBRARY = new GameLibrary;
-        LIBRARY->initializeFilesystem(false);
+    // Must be called with VCMI_BIN_DIR as workdir
+    void initLibrary(const InitArgs &a) {
+        std::call_once(flag_library, [&a]() {
+            processArguments(a);
+            configureLogging(a);
+            // logGlobal->debug("settings = %s", settings.toJsonNode().toJson());
+
+            boost::thread loading([]() {
+                try
+                {
+                    CStopWatch tmh;
+                    LIBRARY->initializeLibrary();
+                    logGlobal->info("Initializing VCMI_Lib: %d ms", tmh.getDiff());
+                }
+                catch (const DataLoadingException & e)
+                {
+                    criticalInitializationError = e.what();
+                    return;
+                }
+            });
+            loading.join();
+        });
 
-        // validating after preinitDLL as the VCMIDirs are not initialized before it
-        validateArguments(a);
+        if (criticalInitializationError.has_value()) {
+            auto msg = criticalInitializationError.value();
+            logGlobal->error("FATAL ERROR ENCOUTERED, VCMI WILL NOW TERMINATE");
+            logGlobal->error("Reason: %s", msg);
+            std::string messageToShow = "Fatal error! " + msg;
+            throw std::runtime_error(msg);
+        }
+    }
 
-        fs::current_path(wd);
+    Session::Session(const InitArgs &a)
+    : args(a)
+    , mapname(mapPath(a).string())
+    , headless(a.headless)
+    , baggage(std::make_unique<MMAI::Schema::Baggage>()) {
+        baggage->modelLeft = a.leftModel;
+        baggage->modelRight = a.rightModel;
+    }
 
-        processArguments(a);
+    void Session::init() {
+        // Workdir is process-wide => sessions are initialized one at a time
+        auto l = std::lock_guard(mutex_init);
 
         // chdir needed for VCMI init
         fs::current_path(fs::path(VCMI_BIN_DIR));
+        initFilesystem();
 
-        // printf("map: %s\n", map.c_str());
-        // printf("loglevelGlobal: %s\n", loglevelGlobal.c_str());
-        // printf("loglevelAI: %s\n", loglevelAI.c_str());
-        // printf("headless: %d\n", headless);
+        // validating after preinitDLL as the VCMIDirs are not initialized before it
+        validateArguments(args);
 
-        Settings(settings.write({"battle", "speedFactor"}))->Integer() = 5;
-        Settings(settings.write({"battle", "rangeLimitHighlightOnHover"}))->Bool() = true;
-        Settings(settings.write({"battle", "stickyHeroInfoWindows"}))->Bool() = false;
-        Settings(settings.write({"logging", "console", "format"}))->String() = "[%t][%n] %l %m";
-        Settings(settings.write({"logging", "console", "coloredOutputEnabled"}))->Bool() = true;
+        initLibrary(args);
+        initialized = true;
+    }
 
-        logConfig->configure();
-        // logGlobal->debug("settings = %s", settings.toJsonNode().toJson());
+    namespace {
+        // Runs a function when leaving the scope, also on exceptions
+        class ScopeExit {
+        public:
+            ScopeExit(std::function<void()> f) : f(std::move(f)) {}
+            ~ScopeExit() { f(); }
+            ScopeExit(const ScopeExit &) = delete;
+            ScopeExit & operator=(const ScopeExit &) = delete;
+        private:
+            std::function<void()> f;
+        };
+    }
+
+    void Session::start(bool wait) {
+        if (!initialized)
+            throw std::runtime_error("call init first");
+
+        // GAME, ENGINE and settings are VCMI globals
+        auto lgame = std::unique_lock(mutex_game, std::defer_lock);
+        if (wait)
+            lgame.lock();
+        else if (!lgame.try_lock())
+            throw std::runtime_error("Session: another session is already running in this process");
+
+        {
+            auto l = std::lock_guard(mutex_shutdown);
+            if (flag_shutdown)
+                return;
+        }
+
+        processArguments(args);
+        configureLogging(args);
 
+        if (worker >= 0) {
+            logGlobal->info("worker -> " + std::to_string(worker));
+            // a zero seed means "random" and needs no offset
+            if (args.seed != 0) {
+                Settings(settings.write({"server", "seed"}))->Integer() = args.seed + worker;
+                Settings(settings.write({"server", "ML", "seed"}))->Integer() = args.seed + worker;
+            }
+
+            // A private copy of the stats DB means no lock waits between workers
+            // (the shards are merged offline, see _notes/stats_shards.txt)
+            if (shardStats && args.statsStorage != "-") {
+                auto shard = args.statsStorage + "." + std::to_string(worker);
+                logGlobal->info("statsStorage -> " + shard);
+                Settings(settings.write({"server", "ML", "statsStorage"}))->String() = shard;
+            }
+        }
+
+        // Tears down the globals on every exit path, errors included
+        ScopeExit cleanup([this]() {
+            {
+                // shutdown() reads it under the same lock
+                auto l = std::lock_guard(mutex_shutdown);
+                activeSession = nullptr;
+            }
+
+            GAME.reset();
+
+            if (!headless && graphics) {
+                CMessage::dispose();
+                delete graphics;
+                graphics = nullptr;
+            }
+
+            if (ENGINE) {
+                // must be executed before reset - since unique_ptr resets pointer to null before calling destructor
+                ENGINE->async().wait();
+                ENGINE.reset();
+            }
+        });
+
+        // GameEngine is created in headless sessions too: GAME and the
+        // server handler are not known to work without one
+        // (see _notes/engineless_headless.txt)
         // if (!headless)
             ENGINE = std::make_unique<GameEngine>(headless);
 
         auto aco = AICombatOptions();
-        aco.other = std::make_any<MMAI::Schema::Baggage*>(baggage);
+        aco.other = std::make_any<MMAI::Schema::Baggage*>(baggage.get());
         GAME = std::make_unique<GameInstance>(aco);
 
         if (ENGINE)
             ENGINE->setEngineUser(GAME.get());
 
-        boost::thread loading([]() {
-            try
-            {
-                CStopWatch tmh;
-                LIBRARY->initializeLibrary();
-                logGlobal->info("Initializing VCMI_Lib: %d ms", tmh.getDiff());
-            }
-            catch (const DataLoadingException & e)
-            {
-                criticalInitializationError = e.what();
+        {
+            // Only now shutdown() can reach GAME
+            auto l = std::lock_guard(mutex_shutdown);
+            if (flag_shutdown)
                 return;
-            }
-        });
-        loading.join();
-
-        if (criticalInitializationError.has_value()) {
-            auto msg = criticalInitializationError.value();
-            logGlobal->error("FATAL ERROR ENCOUTERED, VCMI WILL NOW TERMINATE");
-            logGlobal->error("Reason: %s", msg);
-            std::string messageToShow = "Fatal error! " + msg;
-            throw std::runtime_error(msg);
+            activeSession = this;
         }
 
         if (!headless)
@@ -453,11 +548,6 @@ namespace ML {
             ENGINE->cursor().init();
             ENGINE->cursor().show();
         }
-    }
-
-    void start_vcmi() {
-        if (mapname == "")
-            throw std::runtime_error("call init_vcmi first");
 
         logGlobal->info("friendlyAI -> " + settings["server"]["friendlyAI"].String());
         logGlobal->info("playerAI -> " + settings["server"]["playerAI"].String());
@@ -472,7 +562,7 @@ namespace ML {
             if(headless)
              {
                 auto l = std::unique_lock(mutex_shutdown);
-                cond_shutdown.wait(l);
+                cond_shutdown.wait(l, [this] { return flag_shutdown; });
                 std::cout << "VCMI shutdown complete.\n";
             } else {
                 GAME->mainmenu()->makeActiveInterface();
@@ -490,21 +580,324 @@ namespace ML {
             if (ENGINE)
                 ENGINE->windows().clear();
         }
-        GAME.reset();
+    }
 
-        if(!headless) {
-            CMessage::dispose();
-            delete graphics;
-            graphics = nullptr;
+    void Session::shutdown() {
+        auto l = std::lock_guard(mutex_shutdown);
+        cond_shutdown.notify_all();
+        flag_shutdown = true;
+
+        // XXX: start in a thread?
+        if (activeSession == this)
+            GAME->onShutdownRequested(false);
+    }
+
+    void Session::setWorker(int id, int count, bool shardStats_) {
+        worker = id;
+        workers = count;
+        shardStats = shardStats_;
+    }
+
+    void Session::resetStatsShards(int count) {
+        if (args.statsStorage == "-")
+            return;
+
+        // mlclient-merge-stats removes the shards it merged, so a leftover
+        // shard holds stats that would be lost by the reset
+        for (int i=0; i<count; i++) {
+            auto shard = args.statsStorage + "." + std::to_string(i);
+            if (fs::exists(shard))
+                throw std::runtime_error("unmerged stats shard: " + shard + " (merge it with mlclient-merge-stats or delete it)");
         }
-        // must be executed before reset - since unique_ptr resets pointer to null before calling destructor
-        ENGINE->async().wait();
-        ENGINE.reset();
+
+        for (int i=0; i<count; i++) {
+            auto shard = args.statsStorage + "." + std::to_string(i);
+            fs::copy_file(args.statsStorage, shard);
+        }
+    }
+
+    void Session::ReleaseLibrary() {
+        auto l = std::lock_guard(mutex_game);
         delete LIBRARY;
         LIBRARY = nullptr;
         logConfig->deconfigure();
         delete logConfig;
         delete console;
+    }
+
+    Env::Env(const InitArgs &a, ModelWrappers::Handoff * model)
+    : session(a)
+    , model(model) {
+        if (model != a.leftModel && model != a.rightModel)
+            throw std::runtime_error("Env: model must be one of the session's models");
+    }
+
+    Env::~Env() {
+        model->close();
+        session.shutdown();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    StepResult Env::reset() {
+        if (!started) {
+            session.init();
+            thread = std::thread([this]() {
+                // Errors are passed to the host via waitState()
+                auto error = std::exception_ptr();
+                try {
+                    session.start(false);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                model->close(error);
+            });
+            started = true;
+        } else {
+            model->act(MMAI::Schema::ACTION_RESET);
+        }
+
+        return model->waitState();
+    }
+
+    StepResult Env::step(int action) {
+        if (!started)
+            throw std::runtime_error("Env: call reset first");
+
+        model->act(action);
+        return model->waitState();
+    }
+
+    void init_vcmi(InitArgs &a) {
+        defaultSession = std::make_unique<Session>(a);
+        defaultSession->init();
+    }
+
+    static void runDefaultSession() {
+        defaultSession->start();
+        Session::ReleaseLibrary();
         std::cout << "Ending...\n";
-   }
+    }
+
+    void start_vcmi() {
+        if (!defaultSession)
+            throw std::runtime_error("call init_vcmi first");
+
+        // Started only here: start_vcmi_workers() must fork without it
+        console->start();
+        runDefaultSession();
+    }
+
+    // Read by forwardSignal(); only the elements change after the handler
+    // is installed
+    static std::vector<pid_t> workerPids;
+    static volatile sig_atomic_t workersStopping = 0;
+
+    static void forwardSignal(int sig) {
+        workersStopping = 1;
+        for (auto pid : workerPids)
+            if (pid > 0)
+                kill(pid, sig);
+    }
+
+    int start_vcmi_workers(int workers, std::function<void(int)> onFork, bool shardStats, std::function<void()> onExit) {
+        if (!defaultSession)
+            throw std::runtime_error("call init_vcmi first");
+
+        // A respawned worker keeps its shard, so this is done only here
+        if (shardStats)
+            defaultSession->resetStatsShards(workers);
+
+        auto supervisor = getpid();
+        auto respawns = std::vector<int>(workers, 0);
+        auto failed = 0;
+        workerPids.assign(workers, 0);
+
+        auto spawn = [&onFork, &onExit, workers, shardStats, supervisor](int i) {
+            // The console thread is not started in this mode (see
+            // start_vcmi) and the GAME/ENGINE threads are created later,
+            // in each worker.
+            // SIGINT/SIGTERM are blocked before the fork (forwardSignal
+            // must not run in a worker) and stay blocked in the worker,
+            // where they are taken by a thread which shuts the session
+            // down, so that onExit still runs.
+            // Pending output is flushed, or it would be written twice.
+            std::cout.flush();
+            fflush(nullptr);
+
+            sigset_t block, old;
+            sigemptyset(&block);
+            sigaddset(&block, SIGINT);
+            sigaddset(&block, SIGTERM);
+            sigprocmask(SIG_BLOCK, &block, &old);
+
+            auto pid = fork();
+
+            if (pid < 0) {
+                sigprocmask(SIG_SETMASK, &old, nullptr);
+                throw std::runtime_error("fork failed: " + std::string(strerror(errno)));
+            }
+
+            if (pid == 0) {
+                signal(SIGINT, SIG_DFL);
+                signal(SIGTERM, SIG_DFL);
+
+                // SIGCHLD is blocked only for the supervisor's waits
+                auto mask = old;
+                sigdelset(&mask, SIGCHLD);
+                sigaddset(&mask, SIGINT);
+                sigaddset(&mask, SIGTERM);
+                sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+                // The first signal stops the session, a second one exits
+                std::thread([block]() {
+                    int sig;
+                    if (sigwait(&block, &sig) == 0)
+                        defaultSession->shutdown();
+                    if (sigwait(&block, &sig) == 0)
+                        _exit(128 + sig);
+                }).detach();
+
+                // Die with the supervisor instead of being orphaned
+                prctl(PR_SET_PDEATHSIG, SIGTERM);
+                if (getppid() != supervisor)
+                    _exit(1);
+
+                auto status = 0;
+
+                try {
+                    if (onFork)
+                        onFork(i);
+
+                    defaultSession->setWorker(i, workers, shardStats);
+                    runDefaultSession();
+
+                    if (onExit)
+                        onExit();
+                } catch (const std::exception &e) {
+                    std::cerr << "Worker " << i << " failed: " << e.what() << "\n";
+                    status = 1;
+                }
+
+                // Never return into the supervisor's code or run its
+                // atexit handlers and static destructors
+                std::cout.flush();
+                fflush(nullptr);
+                _exit(status);
+            }
+
+            workerPids[i] = pid;
+            sigprocmask(SIG_SETMASK, &old, nullptr);
+            std::cout << "Started worker " << i << " (pid " << pid << ")\n";
+        };
+
+        for (int i=0; i<workers; i++)
+            spawn(i);
+
+        // Signals sent to the supervisor only (e.g. `kill`) reach the workers
+        signal(SIGINT, forwardSignal);
+        signal(SIGTERM, forwardSignal);
+
+        // SIGCHLD stays pending while blocked, so a worker exiting between
+        // waitpid() and sigtimedwait() still ends the wait
+        sigset_t chld;
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld, nullptr);
+
+        using Clock = std::chrono::steady_clock;
+        auto respawnAt = std::vector<std::optional<Clock::time_point>>(workers);
+        auto alive = workers;
+
+        while (alive > 0) {
+            auto now = Clock::now();
+            auto next = std::optional<Clock::time_point>();
+
+            for (int i=0; i<workers; i++) {
+                if (!respawnAt[i])
+                    continue;
+
+                if (workersStopping) {
+                    respawnAt[i].reset();
+                    alive--;
+                } else if (*respawnAt[i] <= now) {
+                    respawnAt[i].reset();
+                    spawn(i);
+                } else if (!next || *respawnAt[i] < *next) {
+                    next = respawnAt[i];
+                }
+            }
+
+            if (alive == 0)
+                break;
+
+            int status;
+            auto pid = waitpid(-1, &status, WNOHANG);
+
+            if (pid < 0 && errno != ECHILD) {
+                if (errno == EINTR)
+                    continue;
+                throw std::runtime_error("waitpid failed: " + std::string(strerror(errno)));
+            }
+
+            if (pid <= 0) {
+                // Wait for a worker to exit, a signal (forwardSignal
+                // interrupts the wait) or the next respawn
+                auto timeout = std::chrono::nanoseconds(std::chrono::seconds(1));
+                if (next)
+                    timeout = std::max(std::chrono::nanoseconds(0), *next - now);
+
+                auto ts = timespec{};
+                ts.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(timeout).count();
+                ts.tv_nsec = (timeout - std::chrono::seconds(ts.tv_sec)).count();
+                sigtimedwait(&chld, nullptr, &ts);
+                continue;
+            }
+
+            auto it = std::find(workerPids.begin(), workerPids.end(), pid);
+            if (it == workerPids.end())
+                continue;
+
+            auto i = std::distance(workerPids.begin(), it);
+            *it = 0;
+
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                std::cout << "Worker " << i << " finished\n";
+                alive--;
+                continue;
+            }
+
+            if (WIFSIGNALED(status))
+                std::cerr << "Worker " << i << " killed by signal " << WTERMSIG(status);
+            else
+                std::cerr << "Worker " << i << " exited with status " << WEXITSTATUS(status);
+
+            if (workersStopping) {
+                std::cerr << "\n";
+                alive--;
+                continue;
+            }
+
+            if (respawns[i] == MAX_WORKER_RESPAWNS) {
+                std::cerr << ", giving up after " << MAX_WORKER_RESPAWNS << " restarts\n";
+                failed++;
+                alive--;
+                continue;
+            }
+
+            // back off, in case the worker fails deterministically; the
+            // other workers are still reaped meanwhile
+            auto delay = 1 << respawns[i]++;
+            std::cerr << ", restarting in " << delay << "s\n";
+            respawnAt[i] = Clock::now() + std::chrono::seconds(delay);
+        }
+
+        sigprocmask(SIG_UNBLOCK, &chld, nullptr);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+
+        Session::ReleaseLibrary();
+        std::cout << "Ending...\n";
+        return failed;
+    }
 }
@@ -18,7 +18,12 @@
 #include <string>
 #include <functional>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include "AI/MMAI/schema/schema.h"
+#include "ML/model_wrappers/handoff.h"
 
 namespace ML {
     namespace fs = std::filesystem;
@@ -28,6 +33,7 @@ namespace ML {
     constexpr auto AI_MMAI_USER = "MMAI_USER"; // for user-provided getAction (gym)
     constexpr auto AI_MMAI_MODEL = "MMAI_MODEL"; // for pre-trained model's getAction
     constexpr auto AI_MMAI_SCRIPT_SUMMONER = "MMAI_SCRIPT_SUMMONER";
+    constexpr auto AI_MMAI_PLUGIN = "MMAI_PLUGIN"; // for a native getAction (see model_wrappers/plugin_abi.h)
 
     const std::vector<std::string> AIS = {
         AI_STUPIDAI,
@@ -35,6 +41,7 @@ namespace ML {
         AI_MMAI_USER,
         AI_MMAI_MODEL,
         AI_MMAI_SCRIPT_SUMMONER,
+        AI_MMAI_PLUGIN,
     };
 
     const std::vector<std::string> LOGLEVELS = {"trace", "debug", "info", "warn", "error"};
@@ -131,8 +138,91 @@ namespace ML {
         const bool headless;
     };
 
+    // A single game run (map, models, ML server settings, shutdown state).
+    // The VCMI library is loaded on the first init() and shared read-only
+    // by all sessions in the process.
+    // NOTE: GAME, ENGINE and settings are VCMI process globals, so sessions
+    //       never run in parallel: start() holds a process-wide lock for
+    //       the whole game and sessions on other threads wait for it.
+    //       Use start_vcmi_workers() for parallel games.
+    class MMAI_DLL_LINKAGE Session {
+    public:
+        Session(const InitArgs &a);
+
+        void init();
+        // Blocks while another session is running, unless `wait` is false,
+        // in which case it throws instead.
+        void start(bool wait = true);
+        void shutdown();
+
+        // Marks this session as worker `id` of `count` forked workers: the
+        // seed is offset by `id`.
+        // With `shardStats`, stats are persisted to `<statsStorage>.<id>`
+        // (see resetStatsShards) instead of the shared file.
+        void setWorker(int id, int count, bool shardStats);
+
+        // Creates the `count` stats shards as fresh copies of statsStorage.
+        // Called once per run, before the workers start, so that a shard
+        // never carries counters that were already merged into the base.
+        // Throws if a shard from an earlier run was not merged yet.
+        void resetStatsShards(int count);
+
+        // Frees the shared library (call after the last session has ended)
+        static void ReleaseLibrary();
+    private:
+        const InitArgs args;
+        const std::string mapname;
+        const bool headless;
+        std::unique_ptr<MMAI::Schema::Baggage> baggage;
+
+        std::mutex mutex_shutdown;
+        std::condition_variable cond_shutdown;
+        bool flag_shutdown = false;
+        bool initialized = false;
+        int worker = -1;
+        int workers = 0;
+        bool shardStats = false;
+    };
+
+    // Host-driven alternative to handing VCMI a callback model: the session
+    // runs on a background thread and the host pulls states via reset/step.
+    // `model` must be the left or right model in `a`.
+    // Only one session can run at a time: reset/step throw if another one
+    // is running, if the session fails or once it ends (e.g. maxBattles).
+    class MMAI_DLL_LINKAGE Env {
+    public:
+        Env(const InitArgs &a, ModelWrappers::Handoff * model);
+        ~Env();
+
+        StepResult reset();
+        StepResult step(int action);
+    private:
+        Session session;
+        ModelWrappers::Handoff * model;
+        std::thread thread;
+        bool started = false;
+    };
+
+    // Single-session API (uses a process-wide default session)
     void MMAI_DLL_LINKAGE init_vcmi(InitArgs &a);
     void MMAI_DLL_LINKAGE start_vcmi();
+
+    // Forks N copy-on-write workers after init_vcmi (which has already
+    // loaded the library) and runs the default session in each of them.
+    // Crashed workers are re-forked (with a growing delay) up to
+    // MAX_WORKER_RESPAWNS times each. SIGINT/SIGTERM are forwarded to the
+    // workers, which also get SIGTERM if the supervisor dies.
+    // `onFork` is called in each worker (with its index) before it starts
+    // and `onExit` after it ends; workers leave via _exit(), so atexit
+    // handlers registered before the fork do not run in them.
+    // Returns the number of workers which were given up on.
+    constexpr int MAX_WORKER_RESPAWNS = 5;
+    int MMAI_DLL_LINKAGE start_vcmi_workers(
+        int workers,
+        std::function<void(int)> onFork = nullptr,
+        bool shardStats = false,
+        std::function<void()> onExit = nullptr
+    );
     void MMAI_DLL_LINKAGE shutdown_vcmi();
 }
 [[noreturn]] void handleFatalError(const std::string & message, bool terminate);
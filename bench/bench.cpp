@@ -0,0 +1,225 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+// Runs a fixed suite of mlclient-cli --benchmark scenarios and compares the
+// results against a baseline, failing if any metric regressed by more than
+// the given threshold, if a scenario fails, or if a non-empty baseline lacks
+// any metric.
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+namespace po = boost::program_options;
+namespace pt = boost::property_tree;
+namespace fs = std::filesystem;
+
+namespace ML {
+    namespace Bench {
+        struct Metric {
+            std::string name;
+            bool higherIsBetter;
+        };
+
+        const std::vector<Metric> METRICS = {
+            {"startup_seconds", false},
+            {"steps_per_sec", true},
+            {"resets_per_sec", true},
+            {"peak_rss_kb", false},
+            {"allocations_per_step", false},
+        };
+
+        // Runs mlclient-cli with the given args and returns its benchmark
+        // summary, extended with peak_rss_kb
+        pt::ptree runScenario(const std::string &cli, std::vector<std::string> args, const fs::path &output) {
+            fs::remove(output);
+
+            args.insert(args.begin(), cli);
+            args.push_back("--headless");
+            args.push_back("--benchmark");
+            args.push_back("--benchmark-output");
+            args.push_back(output.string());
+
+            auto argv = std::vector<char*>();
+            for (auto &arg : args)
+                argv.push_back(arg.data());
+            argv.push_back(nullptr);
+
+            auto pid = fork();
+            if (pid < 0)
+                throw std::runtime_error("fork failed");
+
+            if (pid == 0) {
+                execv(cli.c_str(), argv.data());
+                perror("execv");
+                _exit(127);
+            }
+
+            int status;
+            struct rusage usage;
+            if (wait4(pid, &status, 0, &usage) < 0)
+                throw std::runtime_error("wait4 failed");
+
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                throw std::runtime_error("mlclient-cli failed (status " + std::to_string(status) + ")");
+
+            auto result = pt::ptree();
+            pt::read_json(output.string(), result);
+            // ru_maxrss is in KB on Linux
+            result.put("peak_rss_kb", usage.ru_maxrss);
+            return result;
+        }
+
+        int main(int argc, char * argv[]) {
+            auto suitePath = std::string(MLCLIENT_BENCH_DIR "/suite.json");
+            auto baselinePath = std::string(MLCLIENT_BENCH_DIR "/baseline.json");
+            auto cli = std::string(VCMI_BIN_DIR "/mlclient-cli");
+            auto threshold = 0.1;
+            auto update = false;
+
+            auto opts = po::options_description("Usage: " + std::string(argv[0]) + " [options]\n\nAvailable options", 120);
+            opts.add_options()
+                ("help,h", "Show this help")
+                ("suite", po::value<std::string>(&suitePath)->value_name("<FILE>"), "Scenario suite JSON")
+                ("baseline", po::value<std::string>(&baselinePath)->value_name("<FILE>"), "Baseline results JSON (if missing or empty, the results are only reported)")
+                ("cli", po::value<std::string>(&cli)->value_name("<FILE>"), "Path to mlclient-cli")
+                ("threshold", po::value<double>(&threshold)->value_name("<F>"), "Max allowed relative regression (default 0.1)")
+                ("update-baseline", po::bool_switch(&update), "Write the results as the new baseline");
+
+            po::variables_map vm;
+
+            try {
+                po::store(po::command_line_parser(argc, argv).options(opts).run(), vm);
+                po::notify(vm);
+            } catch (const po::error& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                std::cout << opts << "\n";
+                return 1;
+            }
+
+            if (vm.count("help")) {
+                std::cout << opts << "\n";
+                return 1;
+            }
+
+            auto suite = pt::ptree();
+            pt::read_json(suitePath, suite);
+
+            auto baseline = pt::ptree();
+            if (fs::is_regular_file(baselinePath))
+                pt::read_json(baselinePath, baseline);
+
+            // Without any baseline the results are only reported. A
+            // baseline missing some of the metrics is an error.
+            auto compare = !baseline.empty();
+            if (!compare && !update)
+                printf("No baseline in %s: reporting only (create one with --update-baseline)\n", baselinePath.c_str());
+
+            auto common = std::vector<std::string>();
+            for (auto &[_, arg] : suite.get_child("args"))
+                common.push_back(arg.get_value<std::string>());
+
+            auto output = fs::temp_directory_path() / ("mlclient-bench-" + std::to_string(getpid()) + ".json");
+            auto results = pt::ptree();
+            auto regressions = 0;
+            auto missing = 0;
+            auto failed = 0;
+
+            for (auto &[_, scenario] : suite.get_child("scenarios")) {
+                auto name = scenario.get<std::string>("name");
+                auto args = common;
+                for (auto &[_, arg] : scenario.get_child("args"))
+                    args.push_back(arg.get_value<std::string>());
+
+                printf("*** %s\n", name.c_str());
+                auto values = std::vector<double>();
+
+                try {
+                    auto result = runScenario(cli, args, output);
+                    for (auto &metric : METRICS)
+                        values.push_back(result.get<double>(metric.name));
+                } catch (const std::exception &e) {
+                    printf("  FAILED: %s\n", e.what());
+                    failed++;
+                    continue;
+                }
+
+                auto base = baseline.get_child_optional(name);
+
+                for (size_t i=0; i<METRICS.size(); i++) {
+                    auto &metric = METRICS[i];
+                    auto value = values[i];
+                    results.put(name + "." + metric.name, value);
+
+                    if (!compare || !base || !base->get_optional<double>(metric.name)) {
+                        printf("  %-22s %12.2f (no baseline)\n", metric.name.c_str(), value);
+                        missing += compare;
+                        continue;
+                    }
+
+                    auto ref = base->get<double>(metric.name);
+                    auto change = ref != 0 ? (value - ref) / ref : 0;
+                    auto regressed = metric.higherIsBetter ? (change < -threshold) : (change > threshold);
+                    printf("  %-22s %12.2f (baseline %.2f, %+.1f%%)%s\n",
+                        metric.name.c_str(), value, ref, 100*change, regressed ? " REGRESSION" : "");
+
+                    if (regressed)
+                        regressions++;
+                }
+            }
+
+            fs::remove(output);
+
+            if (failed > 0) {
+                printf("%d scenario(s) failed\n", failed);
+                return 1;
+            }
+
+            if (update) {
+                pt::write_json(baselinePath, results);
+                printf("Baseline written to %s\n", baselinePath.c_str());
+                return 0;
+            }
+
+            if (regressions > 0) {
+                printf("%d regression(s) above %.0f%%\n", regressions, 100*threshold);
+                return 1;
+            }
+
+            // An incomplete baseline would make the check pass partly unchecked
+            if (missing > 0) {
+                printf("%d metric(s) without a baseline in %s (run with --update-baseline on the reference machine)\n", missing, baselinePath.c_str());
+                return 1;
+            }
+
+            return 0;
+        }
+    }
+}
+
+int main(int argc, char * argv[]) {
+    return ML::Bench::main(argc, argv);
+}
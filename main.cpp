@@ -15,22 +15,49 @@
 // =============================================================================
 
 #include <cstdio>
+#include <cstdlib>
+#include <new>
 #include <stdexcept>
 #include <string>
 #include <boost/program_options.hpp>
 #include <boost/core/demangle.hpp>
 
 #include "AI/MMAI/schema/base.h"
+#include "ML/model_wrappers/plugin.h"
+#include "ML/model_wrappers/recorder.h"
 #include "ML/model_wrappers/scripted.h"
+#include "ML/model_wrappers/shm.h"
 #include "ML/model_wrappers/torchpath.h"
 #include "MLClient.h"
 
-#include "user_agents/agent-v12.h"
-#include "user_agents/agent-v13.h"
+#include "user_agents/agent.h"
+#include "user_agents/benchmark.h"
+#include "user_agents/replay.h"
 
 
 namespace po = boost::program_options;
 
+// Count heap allocations for the per-step allocation metric (only with
+// --benchmark, otherwise the counter would be a shared write on every
+// allocation). Replacing the global operator new in the executable (and
+// not in a library it links) also covers the allocations made by the VCMI
+// libraries.
+void * operator new(std::size_t size) {
+    if (ML::UserAgents::Benchmark::CountAllocations.load(std::memory_order_relaxed))
+        ML::UserAgents::Benchmark::Allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept {
+    std::free(p);
+}
+
 #define LOG(msg) printf("<%s>[CPP][%s] (%s) %s\n", boost::lexical_cast<std::string>(boost::this_thread::get_id()).c_str(), std::filesystem::path(__FILE__).filename().string().c_str(), __FUNCTION__, msg);
 #define LOGSTR(msg, a1) printf("<%s>[CPP][%s] (%s) %s\n", boost::lexical_cast<std::string>(boost::this_thread::get_id()).c_str(), std::filesystem::path(__FILE__).filename().string().c_str(), __FUNCTION__, (std::string(msg) + a1).c_str());
 
@@ -51,7 +78,50 @@ namespace ML {
         return "Values: " + boost::algorithm::join(all, " | ");
     }
 
-    InitArgs parse_args(int argc, char * argv[]) {
+    // Options which affect only mlclient-cli (not passed to init_vcmi)
+    struct CLIOptions {
+        int workers = 0;
+        bool statsShards = false;
+        std::string shmConsume = "";
+        std::shared_ptr<UserAgents::Benchmark> benchmark;
+        std::vector<std::function<void()>> onExit;
+        std::vector<std::function<void(int)>> onFork;  // in each forked worker
+    };
+
+    // Stand-in for an external trainer: answers every state published in
+    // the shared memory ring with a random valid action (or a reset)
+    int consume_shm(std::string name) {
+        auto consumer = ModelWrappers::SharedMemoryConsumer(name);
+        auto header = consumer.getHeader();
+        auto gen = std::mt19937(std::random_device()());
+        auto valid = std::vector<int>{};
+        auto steps = 0;
+
+        printf("Attached to %s (obs: %u, mask: %u, slots: %u)\n", name.c_str(), header->obsSize, header->maskSize, header->nslots);
+
+        while (auto slot = consumer.next()) {
+            steps++;
+
+            if (slot->done) {
+                consumer.reply(MMAI::Schema::ACTION_RESET);
+                continue;
+            }
+
+            auto mask = slot->mask(header->obsSize);
+            valid.clear();
+            for (uint32_t i = 1; i < header->maskSize; i++)
+                if (mask[i]) valid.push_back(i);
+
+            consumer.reply(valid.empty()
+                ? MMAI::Schema::ACTION_RESET
+                : valid[std::uniform_int_distribution<>(0, valid.size() - 1)(gen)]);
+        }
+
+        printf("Producer closed the ring after %d steps\n", steps);
+        return 0;
+    }
+
+    InitArgs parse_args(int argc, char * argv[], CLIOptions &cli) {
         int maxBattles = 0;
         int seed = 0;
         int randomHeroes = 0;
@@ -69,8 +139,13 @@ namespace ML {
         bool interactive = false;
         bool prerecorded = false;
         bool autorender = false;
+        bool selfPlay = false;
         int statsTimeout = 60000;
         int statsPersistFreq = 0;
+        int benchmarkWarmup = 0;
+        std::string benchmarkOutput = "";
+        std::string shmName = "";
+        std::string recordPrefix = "";
         bool headless = false;
 
         // std::vector<std::string> ais = {"StupidAI", "BattleAI", "MMAI", "MMAI_MODEL"};
@@ -83,8 +158,11 @@ namespace ML {
             {"right-ai", AI_STUPIDAI},
             {"left-model", "AI/MMAI/models/model.zip"},
             {"right-model", "AI/MMAI/models/model.zip"},
+            {"left-plugin", "libmmai-plugin.so"},
+            {"right-plugin", "libmmai-plugin.so"},
             {"stats-mode", "disabled"},
-            {"stats-storage", "-"}
+            {"stats-storage", "-"},
+            {"user-agent-version", UserAgents::AgentVersions().front()}
         };
 
         auto usage = std::stringstream();
@@ -97,6 +175,8 @@ namespace ML {
             ("help,h", "Show this help")
             ("headless", po::bool_switch(&headless),
                 "Disable GUI (run in headless mode)")
+            ("workers", po::value<int>()->value_name("<N>"),
+                "Load VCMI once, then fork N workers with seeds SEED..SEED+N-1 (disabled if 0*)")
             ("map", po::value<std::string>()->value_name("<MAP>"),
                 ("Path to map (" + omap.at("map") + "*)").c_str())
             ("max-battles", po::value<int>()->value_name("<N>"),
@@ -130,10 +210,18 @@ namespace ML {
                 values(AIS, omap.at("left-ai")).c_str())
             ("right-ai", po::value<std::string>()->value_name("<AI>"),
                 values(AIS, omap.at("right-ai")).c_str())
+            ("user-agent-version", po::value<std::string>()->value_name("<V>"),
+                ("Schema version of MMAI_USER agents (and of the --shm-name states). " + values(UserAgents::AgentVersions(), omap.at("user-agent-version"))).c_str())
             ("left-model", po::value<std::string>()->value_name("<FILE>"),
                 ("Path to model.zip (" + omap.at("left-model") + "*)").c_str())
             ("right-model", po::value<std::string>()->value_name("<FILE>"),
                 ("Path to model.zip (" + omap.at("right-model") + "*)").c_str())
+            ("left-plugin", po::value<std::string>()->value_name("<FILE>"),
+                ("Path to a MMAI_PLUGIN shared object (" + omap.at("left-plugin") + "*)").c_str())
+            ("right-plugin", po::value<std::string>()->value_name("<FILE>"),
+                ("Path to a MMAI_PLUGIN shared object (" + omap.at("right-plugin") + "*)").c_str())
+            ("self-play", po::bool_switch(&selfPlay),
+                "Use a single MMAI_USER agent for both sides (requires --left-ai and --right-ai MMAI_USER)")
             ("loglevel-global", po::value<std::string>()->value_name("<LVL>"),
                 values(LOGLEVELS, omap.at("loglevel-global")).c_str())
             ("loglevel-ai", po::value<std::string>()->value_name("<LVL>"),
@@ -143,17 +231,37 @@ namespace ML {
             ("interactive", po::bool_switch(&interactive),
                 "Ask for each action")
             ("prerecorded", po::bool_switch(&prerecorded),
-                "Replay actions from local file named actions.txt")
+                "Replay actions from local file named actions.txt (same as --replay actions.txt)")
+            ("replay", po::value<std::string>()->value_name("<FILE>"),
+                "Replay actions from a binary replay file, a --record trajectory (.traj) or a text file (.txt). "
+                "In text files -1 ends the episode: the actions after it are used from the next battle on "
+                "(before, -1 was replayed as an ACTION_RESET within one flat list)")
+            ("replay-export", po::value<std::string>()->value_name("<FILE>"),
+                "Save the --replay actions as a binary replay file and exit (with --seed, the seed is saved too; "
+                "episodes from a .traj file keep their side)")
+            ("record", po::value<std::string>()->value_name("<PREFIX>"),
+                "Record the trajectories of MMAI_USER sides to <PREFIX>-left.traj and <PREFIX>-right.traj (with --workers, worker W adds a .W suffix)")
             ("benchmark", po::bool_switch(&benchmark),
                 "Measure performance")
+            ("benchmark-warmup", po::value<int>()->value_name("<N>"),
+                "Number of initial steps excluded from --benchmark measurements (default 0*)")
+            ("benchmark-output", po::value<std::string>()->value_name("<FILE>"),
+                "File to write the --benchmark JSON summary to on exit (stderr if not given). With --workers, worker W writes <FILE>.W")
             ("auto-render", po::bool_switch(&autorender),
                 "Render each step")
+            ("shm-name", po::value<std::string>()->value_name("<NAME>"),
+                "Export MMAI_USER states to shared memory rings <NAME>-left and <NAME>-right instead of picking actions "
+                "(<NAME>-left-<WORKER> etc. with --workers)")
+            ("shm-consume", po::value<std::string>()->value_name("<NAME>"),
+                "Do not start VCMI, but answer the states in shared memory ring <NAME> with random actions")
             ("stats-mode", po::value<std::string>()->value_name("<MODE>"),
                 ("Stats collection mode. " + values(STATPERSPECTIVES, omap.at("stats-mode"))).c_str())
             ("stats-storage", po::value<std::string>()->value_name("<PATH>"),
                 "File path to read and persist stats to (use -* for in-memory)")
             ("stats-timeout", po::value<int>()->value_name("<N>"),
                 "Timeout in ms for obtaining a DB lock in stats storage (default 60000*)")
+            ("stats-shards", po::bool_switch(&cli.statsShards),
+                "With --workers, make each worker persist stats to its own copy <PATH>.<WORKER> of the stats storage (created on every run, merge with mlclient-merge-stats before the next one)")
             ("stats-persist-freq", po::value<int>()->value_name("<N>"),
                 "Persist stats to storage file every N battles (read only if 0*)");
 
@@ -223,26 +331,77 @@ namespace ML {
         if (vm.count("stats-persist-freq"))
             statsPersistFreq = vm.at("stats-persist-freq").as<int>();
 
-        std::vector<int> recordings = {};
+        if (vm.count("benchmark-warmup"))
+            benchmarkWarmup = vm.at("benchmark-warmup").as<int>();
+
+        if (benchmarkWarmup < 0) {
+            std::cerr << "Bad value for benchmark-warmup: expected a non-negative integer, got: " << benchmarkWarmup << "\n";
+            exit(1);
+        }
+
+        if (vm.count("benchmark-output"))
+            benchmarkOutput = vm.at("benchmark-output").as<std::string>();
+
+        if (vm.count("record"))
+            recordPrefix = vm.at("record").as<std::string>();
+
+        if (vm.count("shm-name"))
+            shmName = vm.at("shm-name").as<std::string>();
+
+        if (vm.count("shm-consume"))
+            cli.shmConsume = vm.at("shm-consume").as<std::string>();
 
-        if (prerecorded) {
-            std::ifstream inputFile("actions.txt"); // Assuming the integers are stored in a file named "input.txt"
-            if (!inputFile.is_open()) throw std::runtime_error("Failed to open actions.txt");
-            int num;
-            while (inputFile >> num) {
-                std::cout << "Loaded action: " << num << "\n";
-                recordings.push_back(num);
+        if (vm.count("workers"))
+            cli.workers = vm.at("workers").as<int>();
+
+        if (cli.workers < 0) {
+            std::cerr << "Bad value for workers: expected a non-negative integer, got: " << cli.workers << "\n";
+            exit(1);
+        }
+
+        if (cli.workers > 0 && !headless) {
+            std::cerr << "--workers requires --headless\n";
+            exit(1);
+        }
+
+        if (cli.statsShards && cli.workers == 0) {
+            std::cerr << "--stats-shards requires --workers\n";
+            exit(1);
+        }
+
+        std::shared_ptr<UserAgents::Replay> replay;
+
+        if (vm.count("replay"))
+            replay = UserAgents::Replay::Load(vm.at("replay").as<std::string>());
+        else if (prerecorded)
+            replay = UserAgents::Replay::Load("actions.txt");
+
+        if (vm.count("replay-export")) {
+            if (!replay) {
+                std::cerr << "--replay-export requires --replay\n";
+                exit(1);
             }
+
+            // The actions are only deterministic with the seed they were recorded with
+            if (vm.count("seed"))
+                replay->setSeed(seed);
+
+            replay->save(vm.at("replay-export").as<std::string>());
+            exit(0);
+        }
+
+        if (replay) {
+            printf("Loaded %u recorded episodes\n", replay->size());
+
+            // Replays are only deterministic with the recorded seed
+            if (!vm.count("seed") && replay->getSeed() != 0)
+                seed = replay->getSeed();
         }
 
         if (benchmark) {
-            if (
-                omap.at("left-ai") != AI_MMAI_USER &&
-                omap.at("left-ai") != AI_MMAI_MODEL &&
-                omap.at("right-ai") != AI_MMAI_USER &&
-                omap.at("right-ai") != AI_MMAI_MODEL
-            ) {
-                printf("--benchmark requires at least one AI of type MMAI_USER or MMAI_MODEL.\n");
+            // Only the user agents are measured
+            if (omap.at("left-ai") != AI_MMAI_USER && omap.at("right-ai") != AI_MMAI_USER) {
+                printf("--benchmark requires at least one AI of type MMAI_USER.\n");
                 exit(1);
             }
 
@@ -259,8 +418,20 @@ namespace ML {
                 : printf("\n");
 
             printf("\n");
+
+            cli.benchmark = std::make_shared<UserAgents::Benchmark>(benchmarkWarmup, benchmarkOutput);
+            cli.onFork.push_back([benchmark = cli.benchmark](int worker) { benchmark->setWorker(worker); });
+            cli.onExit.push_back([benchmark = cli.benchmark]() { benchmark->summary(); });
+        }
+
+        auto versions = UserAgents::AgentVersions();
+        if (std::find(versions.begin(), versions.end(), omap.at("user-agent-version")) == versions.end()) {
+            std::cerr << "Bad value for user-agent-version: " << omap.at("user-agent-version") << "\n";
+            exit(1);
         }
 
+        auto agentVersion = std::stoi(omap.at("user-agent-version"));
+
         auto leftAi = omap.at("left-ai");
         auto rightAi = omap.at("right-ai");
 
@@ -269,26 +440,93 @@ namespace ML {
         std::string leftModelFile = "";
         std::string rightModelFile = "";
 
-        if (leftAi == AI_MMAI_USER) {
-            leftModel = new UserAgents::AgentV13(benchmark, interactive, autorender, false, recordings);
+        auto makePlugin = [](std::string path, MMAI::Schema::Side side) {
+            try {
+                return new ModelWrappers::Plugin(path, side);
+            } catch (const std::exception &e) {
+                std::cerr << "Bad MMAI_PLUGIN: " << e.what() << "\n";
+                exit(1);
+            }
+        };
+
+        auto makeShm = [&cli, agentVersion](std::string name, MMAI::Schema::Side side) {
+            auto shm = new ModelWrappers::SharedMemory(agentVersion, name, side, 16);
+            // each worker gets its own ring
+            cli.onFork.push_back([shm](int worker) { shm->setWorker(worker); });
+            // lets the consumer see the end of the run
+            cli.onExit.push_back([shm]() { shm->close(); });
+            return shm;
+        };
+
+        if (selfPlay && (leftAi != AI_MMAI_USER || rightAi != AI_MMAI_USER || !shmName.empty())) {
+            std::cerr << "--self-play requires --left-ai and --right-ai " << AI_MMAI_USER << " (and no --shm-name)\n";
+            exit(1);
+        }
+
+        if (selfPlay) {
+            // One agent (and one RNG stream) for both sides
+            auto agent = UserAgents::MakeAgent(agentVersion, cli.benchmark, interactive, autorender, false, replay, seed, 0);
+            // the render shows the whole battlefield => one side is enough
+            agent->setRenderSide(0);
+            cli.onFork.push_back([agent, seed](int worker) { agent->reseed(seed ? seed + worker : 0, 0); });
+            cli.onExit.push_back([agent]() {
+                auto &l = agent->getStats(0);
+                auto &r = agent->getStats(1);
+                printf("Self-play: left %lu steps / %lu battles, right %lu steps / %lu battles\n", l.steps, l.battles, r.steps, r.battles);
+            });
+            leftModel = agent;
+            rightModel = agent;
+        } else if (leftAi == AI_MMAI_USER && !shmName.empty()) {
+            leftModel = makeShm(shmName + "-left", MMAI::Schema::Side::LEFT);
+        } else if (leftAi == AI_MMAI_USER) {
+            auto agent = UserAgents::MakeAgent(agentVersion, cli.benchmark, interactive, autorender, false, replay, seed, 0);
+            cli.onFork.push_back([agent, seed](int worker) { agent->reseed(seed ? seed + worker : 0, 0); });
+            leftModel = agent;
             // prevent double render if both models are MMAI_USER
             autorender = false;
         } else if (leftAi == AI_MMAI_MODEL) {
             // BAI will load the actual model based on leftModel->getName()
-            leftModel = new ModelWrappers::TorchPath(omap.at("left-model"));
+            leftModel = ModelWrappers::TorchPath::Get(omap.at("left-model"));
+        } else if (leftAi == AI_MMAI_PLUGIN) {
+            leftModel = makePlugin(omap.at("left-plugin"), MMAI::Schema::Side::LEFT);
         } else {
             leftModel = new ModelWrappers::Scripted(leftAi, MMAI::Schema::Side::LEFT);
         }
 
-        if (rightAi == AI_MMAI_USER) {
-            rightModel = new UserAgents::AgentV13(benchmark, interactive, autorender, false, recordings);
+        if (selfPlay) {
+            // rightModel is set above
+        } else if (rightAi == AI_MMAI_USER && !shmName.empty()) {
+            rightModel = makeShm(shmName + "-right", MMAI::Schema::Side::RIGHT);
+        } else if (rightAi == AI_MMAI_USER) {
+            auto agent = UserAgents::MakeAgent(agentVersion, cli.benchmark, interactive, autorender, false, replay, seed, 1);
+            cli.onFork.push_back([agent, seed](int worker) { agent->reseed(seed ? seed + worker : 0, 1); });
+            rightModel = agent;
         } else if (rightAi == AI_MMAI_MODEL) {
             // BAI will load the actual model based on leftModel->getName()
-            rightModel = new ModelWrappers::TorchPath(omap.at("right-model"));
+            rightModel = ModelWrappers::TorchPath::Get(omap.at("right-model"));
+        } else if (rightAi == AI_MMAI_PLUGIN) {
+            rightModel = makePlugin(omap.at("right-plugin"), MMAI::Schema::Side::RIGHT);
         } else {
             rightModel = new ModelWrappers::Scripted(rightAi, MMAI::Schema::Side::RIGHT);
         }
 
+        if (!recordPrefix.empty()) {
+            // Only user models are asked for actions (see Recorder)
+            if (leftModel->getType() == MMAI::Schema::ModelType::USER) {
+                auto recorder = new ModelWrappers::Recorder(leftModel, recordPrefix + "-left.traj");
+                cli.onFork.push_back([recorder](int worker) { recorder->setWorker(worker); });
+                cli.onExit.push_back([recorder]() { recorder->close(); });
+                leftModel = recorder;
+            }
+
+            if (rightModel->getType() == MMAI::Schema::ModelType::USER) {
+                auto recorder = new ModelWrappers::Recorder(rightModel, recordPrefix + "-right.traj");
+                cli.onFork.push_back([recorder](int worker) { recorder->setWorker(worker); });
+                cli.onExit.push_back([recorder]() { recorder->close(); });
+                rightModel = recorder;
+            }
+        }
+
         return InitArgs(
             omap.at("map"),
             leftModel,
@@ -319,8 +557,30 @@ namespace ML {
 }
 
 int main(int argc, char * argv[]) {
-    auto initargs = ML::parse_args(argc, argv);
+    auto cli = ML::CLIOptions();
+    auto initargs = ML::parse_args(argc, argv, cli);
+
+    if (!cli.shmConsume.empty())
+        return ML::consume_shm(cli.shmConsume);
+
     ML::init_vcmi(initargs);
+
+    // Forked workers run the onExit handlers themselves (and the parent
+    // has nothing to report)
+    if (cli.workers > 0) {
+        auto failed = ML::start_vcmi_workers(
+            cli.workers,
+            [&cli](int worker) { for (auto &f : cli.onFork) f(worker); },
+            cli.statsShards,
+            [&cli]() { for (auto &f : cli.onExit) f(); }
+        );
+
+        return failed > 0 ? 1 : 0;
+    }
+
+    static auto onExit = std::move(cli.onExit);
+    std::atexit([]() { for (auto &f : onExit) f(); });
+
     ML::start_vcmi();
     return 0;
 }
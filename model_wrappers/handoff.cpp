@@ -0,0 +1,89 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "handoff.h"
+#include "supplementary.h"
+#include <stdexcept>
+
+namespace ML {
+    namespace ModelWrappers {
+        Handoff::Handoff(int version, std::string name, MMAI::Schema::Side side)
+        : version(version)
+        , name(name)
+        , side(side) {};
+
+        StepResult Handoff::waitState() {
+            auto l = std::unique_lock(mutex);
+            cond.wait(l, [this] { return hasState || closed; });
+
+            if (closed) {
+                if (error)
+                    std::rethrow_exception(error);
+                throw std::runtime_error("Handoff: the session has ended");
+            }
+
+            hasState = false;
+            return {state->getBattlefieldState(), state->getActionMask(), IsBattleEnded(state)};
+        }
+
+        void Handoff::act(int a) {
+            auto l = std::lock_guard(mutex);
+            action = a;
+            hasAction = true;
+            cond.notify_all();
+        }
+
+        void Handoff::close(std::exception_ptr e) {
+            auto l = std::lock_guard(mutex);
+            closed = true;
+            if (!error)
+                error = e;
+            cond.notify_all();
+        }
+
+        MMAI::Schema::ModelType Handoff::getType() {
+            return MMAI::Schema::ModelType::USER;
+        };
+
+        std::string Handoff::getName() {
+            return name;
+        }
+
+        int Handoff::getVersion() {
+            return version;
+        }
+
+        MMAI::Schema::Side Handoff::getSide() {
+            return side;
+        }
+
+        int Handoff::getAction(const MMAI::Schema::IState * s) {
+            auto l = std::unique_lock(mutex);
+            state = s;
+            hasState = true;
+            cond.notify_all();
+            cond.wait(l, [this] { return hasAction || closed; });
+
+            hasAction = false;
+            state = nullptr;
+            return closed ? MMAI::Schema::ACTION_RESET : action;
+        }
+
+        double Handoff::getValue(const MMAI::Schema::IState * s) {
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+
+#include "AI/MMAI/schema/base.h"
+
+namespace ML {
+    struct StepResult {
+        const MMAI::Schema::BattlefieldState * state;
+        const MMAI::Schema::ActionMask * mask;
+        bool done;
+    };
+
+    namespace ModelWrappers {
+        // Hands each state over to a host thread and blocks until the host
+        // replies with an action, turning VCMI's getAction callback into
+        // a pull-based API (see ML::Env).
+        // The pointers in StepResult are valid until the next act() call.
+        class MMAI_DLL_LINKAGE Handoff : public MMAI::Schema::IModel {
+        public:
+            Handoff(int version, std::string name, MMAI::Schema::Side side);
+
+            // Host side
+            // waitState() throws once closed: `error` (if given to close())
+            // is rethrown, otherwise a runtime_error is thrown.
+            StepResult waitState();
+            void act(int action);
+            void close(std::exception_ptr error = nullptr);
+
+            // VCMI side
+            MMAI::Schema::ModelType getType() override;
+            std::string getName() override;
+            int getVersion() override;
+            MMAI::Schema::Side getSide() override;
+            int getAction(const MMAI::Schema::IState * s) override;
+            double getValue(const MMAI::Schema::IState * s) override;
+        private:
+            const int version;
+            const std::string name;
+            const MMAI::Schema::Side side;
+
+            std::mutex mutex;
+            std::condition_variable cond;
+            const MMAI::Schema::IState * state = nullptr;
+            bool hasState = false;
+            bool hasAction = false;
+            bool closed = false;
+            std::exception_ptr error;
+            int action = MMAI::Schema::ACTION_RESET;
+        };
+    }
+}
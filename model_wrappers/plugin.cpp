@@ -0,0 +1,155 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "plugin.h"
+#include "supplementary.h"
+
+#include <stdexcept>
+#include <dlfcn.h>
+
+namespace ML {
+    namespace ModelWrappers {
+        Plugin::Plugin(std::string path, MMAI::Schema::Side side)
+        : path(path), side(side) {
+            // RTLD_LOCAL: plugins do not see each other's symbols
+            handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+            if (!handle)
+                throw std::runtime_error("Plugin: failed to load " + path + ": " + dlerror());
+
+            auto f_version = reinterpret_cast<int (*)()>(symbol("mmai_plugin_version", true));
+            f_getActionBatch = reinterpret_cast<GetActionBatch>(symbol("get_action_batch", true));
+            f_getValueBatch = reinterpret_cast<GetValueBatch>(symbol("get_value_batch", false));
+            version = f_version();
+        };
+
+        Plugin::~Plugin() {
+            if (handle)
+                dlclose(handle);
+        }
+
+        void * Plugin::symbol(const char * name, bool required) {
+            dlerror();
+            auto res = dlsym(handle, name);
+            if (!res && required) {
+                auto err = std::string(dlerror());
+                dlclose(handle);
+                handle = nullptr;
+                throw std::runtime_error("Plugin: " + path + ": missing symbol " + name + ": " + err);
+            }
+            return res;
+        }
+
+        // Must be called with the mutex held
+        void Plugin::call(const MMAI::Schema::IState * const * states, int n) {
+            size_t stateSize = 0;
+            size_t maskSize = 0;
+
+            live.clear();
+            masks.clear();
+            statePtrs.clear();
+            maskPtrs.clear();
+            actions.assign(n, MMAI::Schema::ACTION_RESET);
+
+            for (int i=0; i<n; i++) {
+                auto s = states[i];
+
+                if (s->version() != version)
+                    throw std::runtime_error("Plugin: " + path + " expects schema version " + std::to_string(version) + ", got: " + std::to_string(s->version()));
+
+                if (IsBattleEnded(s))
+                    continue;
+
+                auto state = s->getBattlefieldState();
+                auto mask = s->getActionMask();
+
+                if (statePtrs.empty()) {
+                    stateSize = state->size();
+                    maskSize = mask->size();
+                    masks.reserve(n * maskSize);
+                } else if (state->size() != stateSize || mask->size() != maskSize) {
+                    throw std::runtime_error("Plugin: state or mask size mismatch within a batch");
+                }
+
+                masks.insert(masks.end(), mask->begin(), mask->end());
+                statePtrs.push_back(state->data());
+                live.push_back(i);
+            }
+
+            // masks has its final size only now
+            for (size_t i=0; i<statePtrs.size(); i++)
+                maskPtrs.push_back(masks.data() + i * maskSize);
+
+            if (statePtrs.empty())
+                return;
+
+            results.resize(statePtrs.size());
+
+            auto rc = f_getActionBatch(
+                statePtrs.data(), int(stateSize),
+                maskPtrs.data(), int(maskSize),
+                int(statePtrs.size()), results.data());
+
+            if (rc != 0)
+                throw std::runtime_error("Plugin: " + path + ": get_action_batch returned " + std::to_string(rc));
+
+            for (size_t k=0; k<live.size(); k++)
+                actions[live[k]] = results[k];
+        }
+
+        std::vector<int> Plugin::getActions(const std::vector<const MMAI::Schema::IState*> &states) {
+            auto l = std::lock_guard(mutex);
+            call(states.data(), states.size());
+            return actions;
+        }
+
+        MMAI::Schema::ModelType Plugin::getType() {
+            return MMAI::Schema::ModelType::USER;
+        };
+
+        std::string Plugin::getName() {
+            return path;
+        }
+
+        int Plugin::getVersion() {
+            return version;
+        }
+
+        MMAI::Schema::Side Plugin::getSide() {
+            return side;
+        }
+
+        int Plugin::getAction(const MMAI::Schema::IState * s) {
+            auto l = std::lock_guard(mutex);
+            call(&s, 1);
+            return actions[0];
+        }
+
+        double Plugin::getValue(const MMAI::Schema::IState * s) {
+            if (!f_getValueBatch)
+                return 0;
+
+            auto l = std::lock_guard(mutex);
+            auto state = s->getBattlefieldState();
+            const float * obs = state->data();
+            double value = 0;
+            auto rc = f_getValueBatch(&obs, int(state->size()), 1, &value);
+            if (rc != 0)
+                throw std::runtime_error("Plugin: " + path + ": get_value_batch returned " + std::to_string(rc));
+
+            return value;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "AI/MMAI/schema/base.h"
+#include "plugin_abi.h"
+
+namespace ML {
+    namespace ModelWrappers {
+        // A model implemented natively in a shared object exporting the C
+        // ABI in plugin_abi.h. getAction calls get_action_batch with n=1;
+        // getActions is for hosts which have many states at once (see
+        // _notes/batched_inference.txt).
+        // States of ended battles get ACTION_RESET without calling the plugin.
+        class MMAI_DLL_LINKAGE Plugin : public MMAI::Schema::IModel {
+        public:
+            Plugin(std::string path, MMAI::Schema::Side side);
+            ~Plugin();
+
+            std::vector<int> getActions(const std::vector<const MMAI::Schema::IState*> &states);
+
+            MMAI::Schema::ModelType getType() override;
+            std::string getName() override;
+            int getVersion() override;
+            MMAI::Schema::Side getSide() override;
+            int getAction(const MMAI::Schema::IState * s) override;
+            double getValue(const MMAI::Schema::IState * s) override;
+        private:
+            using GetActionBatch = decltype(&get_action_batch);
+            using GetValueBatch = decltype(&get_value_batch);
+
+            const std::string path;
+            const MMAI::Schema::Side side;
+            void * handle = nullptr;
+            int version;
+            GetActionBatch f_getActionBatch;
+            GetValueBatch f_getValueBatch;
+
+            // re-used between calls to avoid allocations
+            std::mutex mutex;
+            std::vector<uint8_t> masks;
+            std::vector<const float*> statePtrs;
+            std::vector<const uint8_t*> maskPtrs;
+            std::vector<int> live;         // indices of the ongoing battles
+            std::vector<int32_t> results;  // for the ongoing battles only
+            std::vector<int> actions;
+
+            void * symbol(const char * name, bool required);
+            void call(const MMAI::Schema::IState * const * states, int n);  // into `actions`
+        };
+    }
+}
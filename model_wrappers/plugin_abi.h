@@ -0,0 +1,49 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+// C ABI for MMAI_PLUGIN shared objects (see plugin.h).
+// Plugins include this header and export the functions below; it has no
+// dependencies, so plugins can be written in plain C.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Schema version of the states the plugin expects (e.g. 13)
+int mmai_plugin_version(void);
+
+// For each i in [0, n):
+//   states[i] -> the observation (BattlefieldState), state_size floats
+//   masks[i]  -> the action mask, mask_size bytes (1 = valid action)
+// writes the chosen action to out_actions[i].
+// Only states of ongoing battles are passed (battle ends are answered by
+// the client). The pointers are only valid during the call.
+// Returns 0 on success.
+int get_action_batch(
+    const float * const * states, int state_size,
+    const uint8_t * const * masks, int mask_size,
+    int n, int32_t * out_actions);
+
+// Optional: value estimates (0 is used if not exported)
+int get_value_batch(const float * const * states, int state_size, int n, double * out_values);
+
+#ifdef __cplusplus
+}
+#endif
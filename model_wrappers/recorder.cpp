@@ -0,0 +1,317 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "recorder.h"
+#include "supplementary.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace ML {
+    namespace ModelWrappers {
+        Recorder::Recorder(MMAI::Schema::IModel * model, std::string path, int chunkRecords)
+        : model(model)
+        , path(path)
+        , chunkRecords(chunkRecords)
+        // USER models have no value estimate (their getValue is a dummy)
+        , hasValue(model->getType() != MMAI::Schema::ModelType::USER) {
+            if (chunkRecords < 1)
+                throw std::runtime_error("Recorder: expected chunkRecords > 0, got: " + std::to_string(chunkRecords));
+        };
+
+        Recorder::~Recorder() {
+            close();
+        }
+
+        void Recorder::setWorker(int worker) {
+            if (file)
+                throw std::runtime_error("Recorder: setWorker called after the first record");
+            path += "." + std::to_string(worker);
+        }
+
+        // Called on the first state (the sizes are not known before that).
+        // The writer thread is started here (and not in the constructor)
+        // so that recorders survive forking (see start_vcmi_workers)
+        void Recorder::open(const MMAI::Schema::IState * s) {
+            auto obsSize = s->getBattlefieldState()->size();
+            auto maskSize = s->getActionMask()->size();
+
+            header.magic = TrajHeader::MAGIC;
+            header.version = TrajHeader::VERSION;
+            header.obsSize = obsSize;
+            header.maskSize = maskSize;
+            header.chunkRecords = chunkRecords;
+            header.side = uint32_t(model->getSide());
+            header.recordBytes = obsSize * sizeof(float) + (maskSize + 7) / 8 + sizeof(int32_t) + sizeof(float) + 1;
+
+            file = fopen(path.c_str(), "wb");
+            if (!file)
+                throw std::runtime_error("Recorder: failed to open " + path + ": " + strerror(errno));
+
+            if (fwrite(&header, sizeof(header), 1, file) != 1) {
+                auto err = std::string(strerror(errno));
+                fclose(file);
+                file = nullptr;
+                throw std::runtime_error("Recorder: failed to write " + path + ": " + err);
+            }
+
+            // two spare chunks keep the producer from waiting on the writer
+            for (int i=0; i<3; i++)
+                pool.push_back(std::make_unique<Chunk>(chunkRecords * header.recordBytes));
+
+            chunk = std::move(pool.back());
+            pool.pop_back();
+            compressed.resize(compressBound(chunkRecords * header.recordBytes));
+            writer = std::thread([this]() { write(); });
+        }
+
+        void Recorder::close() {
+            if (!file)
+                return;
+
+            {
+                auto l = std::lock_guard(mutex);
+                if (records > 0) {
+                    chunk->resize(records * header.recordBytes);
+                    queue.push_back(std::move(chunk));
+                    records = 0;
+                }
+                closing = true;
+                cond.notify_all();
+            }
+
+            writer.join();
+
+            if (fclose(file) != 0 && error.empty())
+                error = "failed to write " + path + ": " + strerror(errno);
+
+            if (!error.empty())
+                fprintf(stderr, "Recorder: %s\n", error.c_str());
+
+            file = nullptr;
+        }
+
+        void Recorder::enqueue() {
+            auto l = std::unique_lock(mutex);
+            queue.push_back(std::move(chunk));
+            cond.notify_all();
+            cond.wait(l, [this] { return !pool.empty(); });
+            chunk = std::move(pool.back());
+            pool.pop_back();
+            chunk->resize(chunkRecords * header.recordBytes);
+            records = 0;
+
+            if (!error.empty())
+                throw std::runtime_error("Recorder: " + error);
+        }
+
+        void Recorder::write() {
+            auto failed = false;
+
+            while (true) {
+                std::unique_ptr<Chunk> full;
+
+                {
+                    auto l = std::unique_lock(mutex);
+                    cond.wait(l, [this] { return !queue.empty() || closing; });
+                    if (queue.empty())
+                        return;
+                    full = std::move(queue.front());
+                    queue.pop_front();
+                }
+
+                // After an error, chunks are only recycled (the producer
+                // reports the error, see enqueue)
+                auto err = std::string();
+                if (!failed) {
+                    auto len = uLongf(compressed.size());
+                    auto zret = compress2(compressed.data(), &len, full->data(), full->size(), Z_BEST_SPEED);
+                    auto ch = TrajChunkHeader{TrajChunkHeader::MAGIC, uint32_t(len), uint32_t(full->size() / header.recordBytes)};
+
+                    if (zret != Z_OK)
+                        err = "compress2 failed with code " + std::to_string(zret);
+                    else if (fwrite(&ch, sizeof(ch), 1, file) != 1 || fwrite(compressed.data(), 1, len, file) != len || fflush(file) != 0)
+                        err = "failed to write " + path + ": " + strerror(errno);
+                }
+
+                auto l = std::lock_guard(mutex);
+                if (!err.empty()) {
+                    error = err;
+                    failed = true;
+                }
+                pool.push_back(std::move(full));
+                cond.notify_all();
+            }
+        }
+
+        MMAI::Schema::ModelType Recorder::getType() {
+            return model->getType();
+        };
+
+        std::string Recorder::getName() {
+            return model->getName();
+        }
+
+        int Recorder::getVersion() {
+            return model->getVersion();
+        }
+
+        MMAI::Schema::Side Recorder::getSide() {
+            return model->getSide();
+        }
+
+        int Recorder::getAction(const MMAI::Schema::IState * s) {
+            auto action = model->getAction(s);
+
+            // Render requests are not part of the trajectory
+            if (action == MMAI::Schema::ACTION_RENDER_ANSI)
+                return action;
+
+            if (!file)
+                open(s);
+
+            auto obs = s->getBattlefieldState();
+            auto mask = s->getActionMask();
+            auto value = hasValue ? float(model->getValue(s)) : NAN;
+            auto done = uint8_t(IsBattleEnded(s));
+            auto rec = chunk->data() + records * header.recordBytes;
+
+            std::memcpy(rec, obs->data(), header.obsSize * sizeof(float));
+            rec += header.obsSize * sizeof(float);
+
+            auto maskBytes = (header.maskSize + 7) / 8;
+            std::memset(rec, 0, maskBytes);
+            for (uint32_t i=0; i<header.maskSize; i++)
+                if ((*mask)[i]) rec[i / 8] |= (1 << (i % 8));
+            rec += maskBytes;
+
+            auto act32 = int32_t(action);
+            std::memcpy(rec, &act32, sizeof(act32));
+            rec += sizeof(act32);
+            std::memcpy(rec, &value, sizeof(value));
+            rec += sizeof(value);
+            *rec = done;
+
+            if (++records == chunkRecords)
+                enqueue();
+
+            return action;
+        }
+
+        double Recorder::getValue(const MMAI::Schema::IState * s) {
+            return model->getValue(s);
+        }
+
+        //
+        // TrajectoryReader
+        //
+
+        TrajectoryReader::TrajectoryReader(std::string path) {
+            auto fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("TrajectoryReader: failed to open " + path + ": " + strerror(errno));
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                ::close(fd);
+                throw std::runtime_error("TrajectoryReader: failed to stat " + path + ": " + strerror(errno));
+            }
+
+            bytes = st.st_size;
+
+            if (bytes < sizeof(TrajHeader)) {
+                ::close(fd);
+                throw std::runtime_error("TrajectoryReader: file too small: " + path);
+            }
+
+            auto ptr = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+
+            if (ptr == MAP_FAILED)
+                throw std::runtime_error("TrajectoryReader: mmap failed for " + path + ": " + strerror(errno));
+
+            data = static_cast<const uint8_t*>(ptr);
+            std::memcpy(&header, data, sizeof(header));
+
+            if (header.magic != TrajHeader::MAGIC) {
+                munmap(ptr, bytes);
+                throw std::runtime_error("TrajectoryReader: not a trajectory file: " + path);
+            }
+
+            auto recordBytes = header.obsSize * sizeof(float) + (header.maskSize + 7) / 8 + sizeof(int32_t) + sizeof(float) + 1;
+            if (header.version != TrajHeader::VERSION || header.chunkRecords == 0 || header.recordBytes != recordBytes) {
+                munmap(ptr, bytes);
+                throw std::runtime_error("TrajectoryReader: unsupported trajectory file: " + path);
+            }
+
+            // A truncated (or partially written) last chunk is ignored
+            uint64_t n = 0;
+            size_t offset = sizeof(TrajHeader);
+            while (bytes - offset >= sizeof(TrajChunkHeader)) {
+                TrajChunkHeader ch;
+                std::memcpy(&ch, data + offset, sizeof(ch));
+                offset += sizeof(ch);
+
+                if (ch.magic != TrajChunkHeader::MAGIC || ch.records > header.chunkRecords || bytes - offset < ch.compressedBytes)
+                    break;
+
+                chunks.push_back({data + offset, ch.compressedBytes});
+                firstRecord.push_back(n);
+                n += ch.records;
+                offset += ch.compressedBytes;
+            }
+            firstRecord.push_back(n);
+            inflated.resize(size_t(header.chunkRecords) * header.recordBytes);
+        }
+
+        TrajectoryReader::~TrajectoryReader() {
+            munmap(const_cast<uint8_t*>(data), bytes);
+        }
+
+        uint64_t TrajectoryReader::size() const {
+            return firstRecord.back();
+        }
+
+        const TrajHeader & TrajectoryReader::getHeader() const {
+            return header;
+        }
+
+        const uint8_t * TrajectoryReader::record(uint64_t i) {
+            if (i >= size())
+                throw std::out_of_range("TrajectoryReader: record " + std::to_string(i) + " out of range");
+
+            auto it = std::upper_bound(firstRecord.begin(), firstRecord.end(), i);
+            auto c = std::distance(firstRecord.begin(), it) - 1;
+
+            if (c != inflatedChunk) {
+                auto len = uLongf(inflated.size());
+                auto expected = (firstRecord[c + 1] - firstRecord[c]) * header.recordBytes;
+                if (uncompress(inflated.data(), &len, chunks[c].data, chunks[c].compressedBytes) != Z_OK || len != expected)
+                    throw std::runtime_error("TrajectoryReader: corrupt chunk " + std::to_string(c));
+                inflatedChunk = c;
+            }
+
+            return inflated.data() + (i - firstRecord[c]) * header.recordBytes;
+        }
+    }
+}
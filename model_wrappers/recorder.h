@@ -0,0 +1,144 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AI/MMAI/schema/base.h"
+
+namespace ML {
+    namespace ModelWrappers {
+        // Trajectory file format (all integers little-endian):
+        //
+        //   TrajHeader | TrajChunkHeader | chunk 0 | TrajChunkHeader | chunk 1 | ...
+        //
+        // A chunk is a zlib stream of up to `chunkRecords` fixed-size records:
+        //   float obs[obsSize] | uint8 mask[ceil(maskSize/8)] (LSB-first bits)
+        //   | int32 action | float value | uint8 done
+        // Fixed-size records allow reading record I after inflating one chunk.
+        // `value` is NaN for models without a value estimate (MMAI_USER).
+        // Chunks are self-delimiting and written as soon as they are full,
+        // so a file cut short by a crash loses only the incomplete chunk.
+        struct TrajHeader {
+            static constexpr uint32_t MAGIC = 0x5254544d; // "MTTR"
+            static constexpr uint32_t VERSION = 3;
+
+            uint32_t magic;
+            uint32_t version;
+            uint32_t obsSize;
+            uint32_t maskSize;
+            uint32_t chunkRecords;
+            uint32_t recordBytes;
+            uint32_t side;           // MMAI::Schema::Side of the recorded model
+            uint32_t reserved;
+        };
+
+        struct TrajChunkHeader {
+            static constexpr uint32_t MAGIC = 0x4354544d; // "MTTC"
+
+            uint32_t magic;
+            uint32_t compressedBytes;
+            uint32_t records;
+        };
+
+        // Decorates a model by recording (obs, mask, action, value, done) for
+        // each getAction call. Records are buffered in memory; full chunks
+        // are compressed and written by a background thread.
+        // NOTE: TORCH_PATH and SCRIPTED models are only placeholders, BAI
+        //       never calls their getAction (nothing gets recorded).
+        class MMAI_DLL_LINKAGE Recorder : public MMAI::Schema::IModel {
+        public:
+            Recorder(MMAI::Schema::IModel * model, std::string path, int chunkRecords = 4096);
+            ~Recorder();
+
+            // Makes the recorder write to `<path>.<worker>` (call in the worker)
+            void setWorker(int worker);
+
+            // Flushes all records (idempotent). Does not throw (it runs at
+            // exit); write errors go to stderr.
+            void close();
+
+            MMAI::Schema::ModelType getType() override;
+            std::string getName() override;
+            int getVersion() override;
+            MMAI::Schema::Side getSide() override;
+            int getAction(const MMAI::Schema::IState * s) override;
+            double getValue(const MMAI::Schema::IState * s) override;
+        private:
+            using Chunk = std::vector<uint8_t>;
+
+            MMAI::Schema::IModel * const model;
+            std::string path;
+            const int chunkRecords;
+            const bool hasValue;
+
+            TrajHeader header = {};
+            std::unique_ptr<Chunk> chunk;  // being filled
+            int records = 0;               // in `chunk`
+
+            std::thread writer;
+            std::mutex mutex;
+            std::condition_variable cond;
+            std::deque<std::unique_ptr<Chunk>> queue;  // full chunks
+            std::vector<std::unique_ptr<Chunk>> pool;   // free chunks
+            bool closing = false;
+            std::string error;  // set by the writer thread
+
+            // writer thread only
+            FILE * file = nullptr;
+            std::vector<uint8_t> compressed;
+
+            void open(const MMAI::Schema::IState * s);
+            void enqueue();
+            void write();
+        };
+
+        // Reads a trajectory file via mmap, for random sampling of records
+        class MMAI_DLL_LINKAGE TrajectoryReader {
+        public:
+            TrajectoryReader(std::string path);
+            ~TrajectoryReader();
+
+            uint64_t size() const;
+            const TrajHeader & getHeader() const;
+
+            // Returns a pointer to the raw record (valid until the next call)
+            const uint8_t * record(uint64_t i);
+        private:
+            struct Chunk {
+                const uint8_t * data;
+                uint32_t compressedBytes;
+            };
+
+            const uint8_t * data = nullptr;
+            size_t bytes = 0;
+            TrajHeader header;
+            std::vector<Chunk> chunks;
+            std::vector<uint64_t> firstRecord;  // per chunk
+            std::vector<uint8_t> inflated;
+            int64_t inflatedChunk = -1;
+        };
+    }
+}
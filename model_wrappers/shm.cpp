@@ -0,0 +1,287 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "shm.h"
+#include "supplementary.h"
+
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ML {
+    namespace ModelWrappers {
+        namespace {
+            bool isAlive(uint32_t pid) {
+                return pid == 0 || kill(pid_t(pid), 0) == 0 || errno == EPERM;
+            }
+
+            void ring(std::atomic<uint32_t> &bell) {
+                bell.fetch_add(1, std::memory_order_release);
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&bell), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+            }
+
+            // Spins briefly (round-trips are expected to be short), then
+            // sleeps on `bell`, checking `alive` every 100ms.
+            // Returns false if `alive` fails before `ready`.
+            template <typename F, typename A>
+            bool waitUntil(std::atomic<uint32_t> &bell, F ready, A alive) {
+                for (int i=0; i<1000; i++)
+                    if (ready())
+                        return true;
+
+                while (true) {
+                    auto value = bell.load(std::memory_order_acquire);
+                    if (ready())
+                        return true;
+
+                    if (!alive())
+                        return false;
+
+                    struct timespec timeout = {0, 100 * 1000 * 1000};
+                    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&bell), FUTEX_WAIT, value, &timeout, nullptr, 0);
+                }
+            }
+
+            ShmSlot * slotAt(ShmHeader * header, uint64_t seq) {
+                auto base = reinterpret_cast<uint8_t*>(header) + sizeof(ShmHeader);
+                return reinterpret_cast<ShmSlot*>(base + (seq % header->nslots) * header->slotBytes);
+            }
+        }
+
+        SharedMemory::SharedMemory(int version, std::string name, MMAI::Schema::Side side, int nslots)
+        : version(version)
+        , name(name)
+        , side(side)
+        , nslots(nslots) {
+            if (nslots < 1)
+                throw std::runtime_error("SharedMemory: expected at least 1 slot, got: " + std::to_string(nslots));
+        };
+
+        SharedMemory::~SharedMemory() {
+            close();
+        }
+
+        void SharedMemory::setWorker(int worker) {
+            if (header)
+                throw std::runtime_error("SharedMemory: " + name + " is already in use");
+
+            name += "-" + std::to_string(worker);
+        }
+
+        void SharedMemory::close() {
+            if (!header)
+                return;
+
+            header->closed.store(1, std::memory_order_release);
+            ring(header->stateBell);
+            munmap(header, bytes);
+            shm_unlink(name.c_str());
+            header = nullptr;
+        }
+
+        void SharedMemory::create(uint32_t obsSize, uint32_t maskSize) {
+            auto slotBytes = sizeof(ShmSlot) + obsSize * sizeof(float) + maskSize;
+            slotBytes = (slotBytes + 63) / 64 * 64;
+            bytes = sizeof(ShmHeader) + nslots * slotBytes;
+
+            // A stale ring (e.g. of a crashed worker) is replaced, not
+            // truncated: a consumer still attached to it keeps its mapping
+            shm_unlink(name.c_str());
+            auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0)
+                throw std::runtime_error("SharedMemory: shm_open failed for " + name + ": " + strerror(errno));
+
+            if (ftruncate(fd, bytes) < 0) {
+                ::close(fd);
+                throw std::runtime_error("SharedMemory: ftruncate failed for " + name + ": " + strerror(errno));
+            }
+
+            auto ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+
+            if (ptr == MAP_FAILED)
+                throw std::runtime_error("SharedMemory: mmap failed for " + name + ": " + strerror(errno));
+
+            // ftruncate zero-fills, so all atomics start at 0
+            header = static_cast<ShmHeader*>(ptr);
+            header->version = ShmHeader::VERSION;
+            header->nslots = nslots;
+            header->obsSize = obsSize;
+            header->maskSize = maskSize;
+            header->slotBytes = slotBytes;
+            header->producerPid = getpid();
+            header->magic.store(ShmHeader::MAGIC, std::memory_order_release);
+        }
+
+        MMAI::Schema::ModelType SharedMemory::getType() {
+            return MMAI::Schema::ModelType::USER;
+        };
+
+        std::string SharedMemory::getName() {
+            return name;
+        }
+
+        int SharedMemory::getVersion() {
+            return version;
+        }
+
+        MMAI::Schema::Side SharedMemory::getSide() {
+            return side;
+        }
+
+        int SharedMemory::getAction(const MMAI::Schema::IState * s) {
+            auto obs = s->getBattlefieldState();
+            auto mask = s->getActionMask();
+
+            if (!header)
+                create(obs->size(), mask->size());
+
+            if (obs->size() != header->obsSize || mask->size() != header->maskSize)
+                throw std::runtime_error("SharedMemory: state size changed");
+
+            auto slot = slotAt(header, ++seq);
+            slot->seq.store(0, std::memory_order_relaxed);
+            slot->done = IsBattleEnded(s);
+            slot->version = s->version();
+            std::memcpy(slot->obs(), obs->data(), obs->size() * sizeof(float));
+
+            auto m = slot->mask(header->obsSize);
+            for (size_t i=0; i<mask->size(); i++)
+                m[i] = (*mask)[i];
+
+            slot->seq.store(seq, std::memory_order_release);
+            header->published.store(seq, std::memory_order_release);
+            ring(header->stateBell);
+
+            auto answered = waitUntil(
+                header->actionBell,
+                [this] { return header->answered.load(std::memory_order_acquire) >= seq; },
+                [this] { return isAlive(header->consumerPid.load(std::memory_order_acquire)); }
+            );
+
+            if (!answered)
+                throw std::runtime_error("SharedMemory: the consumer of " + name + " has exited");
+
+            return header->action.load(std::memory_order_relaxed);
+        }
+
+        double SharedMemory::getValue(const MMAI::Schema::IState * s) {
+            return 0;
+        }
+
+        //
+        // SharedMemoryConsumer
+        //
+
+        SharedMemoryConsumer::SharedMemoryConsumer(std::string name)
+        : name(name) {
+            // The ring appears once the producer receives its first state
+            auto fd = shm_open(name.c_str(), O_RDWR, 0600);
+            while (fd < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                fd = shm_open(name.c_str(), O_RDWR, 0600);
+            }
+
+            // The size is final once the magic is set
+            ShmHeader * probe = nullptr;
+            while (true) {
+                struct stat st;
+                if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(ShmHeader)) {
+                    if (!probe) {
+                        auto ptr = mmap(nullptr, sizeof(ShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+                        if (ptr == MAP_FAILED) {
+                            auto err = std::string(strerror(errno));
+                            ::close(fd);
+                            throw std::runtime_error("SharedMemoryConsumer: mmap failed for " + name + ": " + err);
+                        }
+                        probe = static_cast<ShmHeader*>(ptr);
+                    }
+
+                    if (probe->magic.load(std::memory_order_acquire) == ShmHeader::MAGIC)
+                        break;
+                }
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+
+            auto version = probe->version;
+            bytes = sizeof(ShmHeader) + size_t(probe->nslots) * probe->slotBytes;
+            munmap(probe, sizeof(ShmHeader));
+
+            if (version != ShmHeader::VERSION) {
+                ::close(fd);
+                throw std::runtime_error("SharedMemoryConsumer: unsupported version: " + std::to_string(version));
+            }
+
+            auto ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+
+            if (ptr == MAP_FAILED)
+                throw std::runtime_error("SharedMemoryConsumer: mmap failed for " + name + ": " + strerror(errno));
+
+            header = static_cast<ShmHeader*>(ptr);
+            header->consumerPid.store(getpid(), std::memory_order_release);
+        }
+
+        SharedMemoryConsumer::~SharedMemoryConsumer() {
+            if (header)
+                munmap(header, bytes);
+        }
+
+        ShmSlot * SharedMemoryConsumer::next() {
+            auto want = seq + 1;
+
+            waitUntil(
+                header->stateBell,
+                [&] {
+                    return header->published.load(std::memory_order_acquire) >= want
+                        || header->closed.load(std::memory_order_acquire);
+                },
+                [this] { return isAlive(header->producerPid); }
+            );
+
+            if (header->published.load(std::memory_order_acquire) < want)
+                return nullptr;
+
+            seq = want;
+            auto slot = slotAt(header, seq);
+
+            if (slot->seq.load(std::memory_order_acquire) != seq)
+                throw std::runtime_error("SharedMemoryConsumer: slot overwritten");
+
+            return slot;
+        }
+
+        void SharedMemoryConsumer::reply(int action) {
+            header->action.store(action, std::memory_order_relaxed);
+            header->answered.store(seq, std::memory_order_release);
+            ring(header->actionBell);
+        }
+
+        const ShmHeader * SharedMemoryConsumer::getHeader() const {
+            return header;
+        }
+    }
+}
@@ -0,0 +1,128 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "AI/MMAI/schema/base.h"
+
+namespace ML {
+    namespace ModelWrappers {
+        // Layout of the /dev/shm ring shared with an external consumer:
+        //
+        //   ShmHeader | ShmSlot 0 | ShmSlot 1 | ... | ShmSlot N-1
+        //
+        // Each slot is followed by `obsSize` floats (observation) and
+        // `maskSize` bytes (action mask, 0 or 1), padded to 64 bytes.
+        // The state with sequence number S (starting at 1) goes into slot
+        // S % N. The consumer replies by storing the action, then S into
+        // `answered` (single-producer/single-consumer).
+        //
+        // Waiting is done on the `*Bell` futex words (Linux, not private),
+        // which are incremented and woken after each update of the fields
+        // they guard. Waiters wake up periodically to check that the other
+        // side's process (by pid, 0 until known) is still alive.
+        struct ShmHeader {
+            static constexpr uint32_t MAGIC = 0x4d4d4149; // "MMAI"
+            static constexpr uint32_t VERSION = 2;
+
+            std::atomic<uint32_t> magic;  // set last, once the layout is ready
+            uint32_t version;
+            uint32_t nslots;
+            uint32_t obsSize;
+            uint32_t maskSize;
+            uint32_t slotBytes;
+            uint32_t producerPid;
+            std::atomic<uint32_t> consumerPid;
+
+            alignas(64) std::atomic<uint64_t> published;
+            std::atomic<uint32_t> stateBell;   // guards `published` and `closed`
+            std::atomic<uint32_t> closed;
+            alignas(64) std::atomic<uint64_t> answered;
+            std::atomic<int32_t> action;
+            std::atomic<uint32_t> actionBell;  // guards `answered`
+        };
+
+        struct alignas(64) ShmSlot {
+            std::atomic<uint64_t> seq;  // 0 while being written
+            uint32_t done;
+            uint32_t version;
+
+            float * obs() { return reinterpret_cast<float*>(this + 1); }
+            uint8_t * mask(uint32_t obsSize) { return reinterpret_cast<uint8_t*>(obs() + obsSize); }
+        };
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free);
+        static_assert(std::atomic<int32_t>::is_always_lock_free);
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));  // futex words
+
+        // Exports each state into a shared memory ring named `name` and
+        // waits for the consumer's action (see ShmHeader).
+        // The ring is created on the first state, once the sizes are known.
+        // getAction throws if the consumer's process has exited.
+        class MMAI_DLL_LINKAGE SharedMemory : public MMAI::Schema::IModel {
+        public:
+            SharedMemory(int version, std::string name, MMAI::Schema::Side side, int nslots);
+            ~SharedMemory();
+
+            // Renames the ring to `<name>-<worker>` (call before the first state)
+            void setWorker(int worker);
+
+            // Marks the ring as closed (the consumer sees the end) and removes it
+            void close();
+
+            MMAI::Schema::ModelType getType() override;
+            std::string getName() override;
+            int getVersion() override;
+            MMAI::Schema::Side getSide() override;
+            int getAction(const MMAI::Schema::IState * s) override;
+            double getValue(const MMAI::Schema::IState * s) override;
+        private:
+            const int version;
+            std::string name;
+            const MMAI::Schema::Side side;
+            const int nslots;
+
+            ShmHeader * header = nullptr;
+            size_t bytes = 0;
+            uint64_t seq = 0;
+
+            void create(uint32_t obsSize, uint32_t maskSize);
+        };
+
+        // Stand-in for an external trainer: attaches to a SharedMemory ring
+        class MMAI_DLL_LINKAGE SharedMemoryConsumer {
+        public:
+            SharedMemoryConsumer(std::string name);
+            ~SharedMemoryConsumer();
+
+            // Waits for the next state; returns nullptr once the producer
+            // has closed the ring (or its process has exited)
+            ShmSlot * next();
+            void reply(int action);
+
+            const ShmHeader * getHeader() const;
+        private:
+            const std::string name;
+            ShmHeader * header = nullptr;
+            size_t bytes = 0;
+            uint64_t seq = 0;
+        };
+    }
+}
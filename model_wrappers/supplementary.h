@@ -0,0 +1,66 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#pragma once
+
+#include <stdexcept>
+#include <utility>
+
+#include "AI/MMAI/schema/base.h"
+#include "AI/MMAI/schema/v12/types.h"
+#include "AI/MMAI/schema/v13/types.h"
+
+namespace ML {
+    namespace ModelWrappers {
+        // Schema types for each supported version
+        template <int V>
+        struct SchemaTypes;
+
+        template <>
+        struct SchemaTypes<12> {
+            using ISupplementaryData = MMAI::Schema::V12::ISupplementaryData;
+        };
+
+        template <>
+        struct SchemaTypes<13> {
+            using ISupplementaryData = MMAI::Schema::V13::ISupplementaryData;
+        };
+
+        // Supported schema versions (the first one is the default), used by
+        // the model wrappers and the user agents alike.
+        // Adding a version requires adding it here and a SchemaTypes
+        // specialization above.
+        using Versions = std::integer_sequence<int, 13, 12>;
+
+        template <int... Vs>
+        bool isBattleEnded(const MMAI::Schema::IState * s, std::integer_sequence<int, Vs...>) {
+            auto any = s->getSupplementaryData();
+            auto res = false;
+            auto found = ((s->version() == Vs && (res = std::any_cast<const typename SchemaTypes<Vs>::ISupplementaryData*>(any)->getIsBattleEnded(), true)) || ...);
+
+            if (!found)
+                throw std::runtime_error("Unsupported state version: " + std::to_string(s->version()));
+
+            return res;
+        }
+
+        // Version-independent access to the supplementary data fields
+        // needed by the model wrappers
+        inline bool IsBattleEnded(const MMAI::Schema::IState * s) {
+            return isBattleEnded(s, Versions{});
+        }
+    }
+}
@@ -16,10 +16,24 @@
 
 #include "torchpath.h"
 #include "ML/MLClient.h"
+#include <map>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 
 namespace ML {
     namespace ModelWrappers {
+        TorchPath * TorchPath::Get(std::string path) {
+            static std::mutex mutex;
+            static std::map<std::string, std::unique_ptr<TorchPath>> instances;
+
+            auto l = std::lock_guard(mutex);
+            auto &res = instances[path];
+            if (!res)
+                res = std::make_unique<TorchPath>(path);
+            return res.get();
+        }
+
         TorchPath::TorchPath(std::string path)
         : path(path) {};
 
@@ -20,8 +20,13 @@
 
 namespace ML {
     namespace ModelWrappers {
+        // Placeholder for a torch model: BAI loads the actual model by
+        // getName() (see _notes/model_cache.txt).
         class MMAI_DLL_LINKAGE TorchPath : public MMAI::Schema::IModel {
         public:
+            // One instance per path, e.g. for both sides in self-play
+            static TorchPath * Get(std::string path);
+
             TorchPath(std::string path);
 
             MMAI::Schema::ModelType getType() override;
@@ -0,0 +1,189 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "./catalog.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ML {
+    namespace Scenarios {
+        std::shared_ptr<const Catalog> Catalog::Load(std::string path) {
+            auto res = std::shared_ptr<Catalog>(new Catalog());
+
+            auto fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("Failed to open " + path + ": " + strerror(errno));
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                auto err = std::string(strerror(errno));
+                close(fd);
+                throw std::runtime_error("Failed to stat " + path + ": " + err);
+            }
+
+            res->bytes = st.st_size;
+
+            if (res->bytes < sizeof(CatalogHeader)) {
+                close(fd);
+                throw std::runtime_error("Not a scenario catalog: " + path);
+            }
+
+            auto ptr = mmap(nullptr, res->bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+
+            if (ptr == MAP_FAILED)
+                throw std::runtime_error("mmap failed for " + path + ": " + strerror(errno));
+
+            res->mapped = ptr;
+            std::memcpy(&res->header, ptr, sizeof(CatalogHeader));
+
+            if (res->header.magic != CatalogHeader::MAGIC || res->header.version != CatalogHeader::VERSION)
+                throw std::runtime_error("Not a scenario catalog (or unsupported version): " + path);
+
+            auto expected = sizeof(CatalogHeader)
+                + size_t(res->header.nbattlefields) * BATTLEFIELD_NAME_SIZE
+                + size_t(res->header.nscenarios) * sizeof(Scenario);
+
+            if (res->bytes != expected)
+                throw std::runtime_error("Corrupt scenario catalog: " + path + " (bad size)");
+
+            auto base = static_cast<const char*>(ptr);
+            res->battlefields = base + sizeof(CatalogHeader);
+            res->scenarios = reinterpret_cast<const Scenario*>(res->battlefields + res->header.nbattlefields * BATTLEFIELD_NAME_SIZE);
+
+            for (uint32_t i=0; i<res->header.nscenarios; i++) {
+                auto bf = res->scenarios[i].battlefield;
+                if (bf < -1 || bf >= int32_t(res->header.nbattlefields))
+                    throw std::runtime_error("Corrupt scenario catalog: " + path + " (scenario " + std::to_string(i) + ")");
+            }
+
+            return res;
+        }
+
+        Catalog::Catalog(int64_t seed) {
+            header.magic = CatalogHeader::MAGIC;
+            header.version = CatalogHeader::VERSION;
+            header.seed = seed;
+        }
+
+        Catalog::~Catalog() {
+            if (mapped)
+                munmap(mapped, bytes);
+        }
+
+        Catalog::Catalog(Catalog &&other) noexcept {
+            *this = std::move(other);
+        }
+
+        Catalog & Catalog::operator=(Catalog &&other) noexcept {
+            if (this == &other)
+                return *this;
+
+            if (mapped)
+                munmap(mapped, bytes);
+
+            header = other.header;
+            mapped = std::exchange(other.mapped, nullptr);
+            bytes = std::exchange(other.bytes, 0);
+            ownBattlefields = std::move(other.ownBattlefields);
+            ownScenarios = std::move(other.ownScenarios);
+
+            if (mapped) {
+                battlefields = other.battlefields;
+                scenarios = other.scenarios;
+            } else {
+                battlefields = ownBattlefields.data();
+                scenarios = ownScenarios.data();
+            }
+
+            // leave `other` as a valid empty catalog
+            other.battlefields = nullptr;
+            other.scenarios = nullptr;
+            other.ownBattlefields.clear();
+            other.ownScenarios.clear();
+            other.header.nbattlefields = 0;
+            other.header.nscenarios = 0;
+            return *this;
+        }
+
+        int32_t Catalog::addBattlefield(const std::string &name) {
+            if (mapped)
+                throw std::runtime_error("Catalog: cannot modify a mapped catalog");
+
+            if (name.size() >= BATTLEFIELD_NAME_SIZE)
+                throw std::runtime_error("Catalog: battlefield name too long: " + name);
+
+            auto offset = ownBattlefields.size();
+            ownBattlefields.resize(offset + BATTLEFIELD_NAME_SIZE, 0);
+            std::memcpy(ownBattlefields.data() + offset, name.data(), name.size());
+
+            battlefields = ownBattlefields.data();
+            return header.nbattlefields++;
+        }
+
+        void Catalog::add(const Scenario &scenario) {
+            if (mapped)
+                throw std::runtime_error("Catalog: cannot modify a mapped catalog");
+
+            if (scenario.battlefield < -1 || scenario.battlefield >= int32_t(header.nbattlefields))
+                throw std::runtime_error("Catalog: bad battlefield index: " + std::to_string(scenario.battlefield));
+
+            ownScenarios.push_back(scenario);
+            scenarios = ownScenarios.data();
+            header.nscenarios = ownScenarios.size();
+        }
+
+        void Catalog::save(std::string path) const {
+            auto f = fopen(path.c_str(), "wb");
+            if (!f)
+                throw std::runtime_error("Failed to open " + path + ": " + strerror(errno));
+
+            auto ok = fwrite(&header, sizeof(header), 1, f) == 1
+                && fwrite(battlefields, BATTLEFIELD_NAME_SIZE, header.nbattlefields, f) == header.nbattlefields
+                && fwrite(scenarios, sizeof(Scenario), header.nscenarios, f) == header.nscenarios;
+
+            if (fclose(f) != 0 || !ok)
+                throw std::runtime_error("Failed to write " + path + ": " + strerror(errno));
+        }
+
+        int64_t Catalog::getSeed() const {
+            return header.seed;
+        }
+
+        uint32_t Catalog::size() const {
+            return header.nscenarios;
+        }
+
+        const Scenario & Catalog::scenario(uint32_t i) const {
+            return scenarios[i];
+        }
+
+        std::string Catalog::battlefield(int32_t i) const {
+            if (i < 0)
+                return "";
+
+            auto name = battlefields + i * BATTLEFIELD_NAME_SIZE;
+            return std::string(name, strnlen(name, BATTLEFIELD_NAME_SIZE));
+        }
+    }
+}
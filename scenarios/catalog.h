@@ -0,0 +1,99 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ML {
+    namespace Scenarios {
+        // Scenario catalog file format (all integers little-endian):
+        //
+        //   CatalogHeader | char battlefields[nbattlefields][32] | Scenario[nscenarios]
+        //
+        // Made by mlclient-scenarios from the same parameters as the
+        // server.ML.* randomization settings (see MLClient.h InitArgs).
+        struct CatalogHeader {
+            static constexpr uint32_t MAGIC = 0x4e43534d; // "MSCN"
+            static constexpr uint32_t VERSION = 1;
+
+            uint32_t magic;
+            uint32_t version;
+            int64_t seed;            // the seed the catalog was generated with
+            uint32_t nbattlefields;
+            uint32_t nscenarios;
+        };
+
+        struct Scenario {
+            static constexpr uint8_t TOWN = 1;
+            static constexpr uint8_t WARMACHINES = 2;
+            static constexpr uint8_t RANDOM_STACKS = 4;
+            static constexpr uint8_t TIGHT_FORMATION = 8;
+            static constexpr uint8_t SWAP_SIDES = 16;
+
+            int32_t battlefield;     // index into the battlefields, -1 for the map's own
+            uint32_t heroSeed;       // 0 for the map's heroes
+            uint32_t obstacleSeed;   // 0 for the default obstacles
+            uint16_t mana;
+            uint8_t flags;
+            uint8_t reserved;
+        };
+
+        constexpr size_t BATTLEFIELD_NAME_SIZE = 32;
+
+        // Pre-generated battle setups. Files are memory-mapped, so forked
+        // workers share the pages.
+        class Catalog {
+        public:
+            static std::shared_ptr<const Catalog> Load(std::string path);
+
+            Catalog(int64_t seed);  // empty, for building with add*
+            ~Catalog();
+
+            // Points into its own buffers or mapping => move-only
+            Catalog(const Catalog &) = delete;
+            Catalog & operator=(const Catalog &) = delete;
+            Catalog(Catalog &&other) noexcept;
+            Catalog & operator=(Catalog &&other) noexcept;
+
+            int32_t addBattlefield(const std::string &name);
+            void add(const Scenario &scenario);
+            void save(std::string path) const;
+
+            int64_t getSeed() const;
+            uint32_t size() const;
+            const Scenario & scenario(uint32_t i) const;
+            std::string battlefield(int32_t i) const;  // "" for -1
+        private:
+            Catalog() = default;
+
+            CatalogHeader header = {};
+            const char * battlefields = nullptr;
+            const Scenario * scenarios = nullptr;
+
+            // mmap-ed file
+            void * mapped = nullptr;
+            size_t bytes = 0;
+
+            // in-memory
+            std::vector<char> ownBattlefields;
+            std::vector<Scenario> ownScenarios;
+        };
+    }
+}
@@ -0,0 +1,242 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+// Generates a scenario catalog (see catalog.h) from the same parameters
+// mlclient-cli uses for per-battle randomization. Nothing reads catalogs
+// yet (see _notes/scenario_catalog.txt).
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "ML/scenarios/catalog.h"
+#include "ML/user_agents/sampler.h"
+
+namespace po = boost::program_options;
+namespace pt = boost::property_tree;
+
+namespace ML {
+    namespace Scenarios {
+        struct Params {
+            int64_t seed = 0;
+            int count = 10000;
+            int randomHeroes = 0;
+            int randomObstacles = 0;
+            int townChance = 0;
+            int warmachineChance = 0;
+            int randomStackChance = 0;
+            int tightFormationChance = 0;
+            int randomTerrainChance = 0;
+            std::string battlefieldPattern = "";
+            int manaMin = 0;
+            int manaMax = 100;
+            int swapSides = 0;
+        };
+
+        // VCMI configs may contain // comments, which property_tree rejects
+        std::string stripComments(const std::string &json) {
+            auto res = std::string();
+            auto quoted = false;
+
+            for (size_t i=0; i<json.size(); i++) {
+                auto c = json[i];
+
+                if (quoted) {
+                    res += c;
+                    if (c == '\\' && i+1 < json.size())
+                        res += json[++i];
+                    else if (c == '"')
+                        quoted = false;
+                } else if (c == '"') {
+                    quoted = true;
+                    res += c;
+                } else if (c == '/' && i+1 < json.size() && json[i+1] == '/') {
+                    while (i < json.size() && json[i] != '\n')
+                        i++;
+                    res += '\n';
+                } else {
+                    res += c;
+                }
+            }
+
+            return res;
+        }
+
+        // Battlefield keys from config/battlefields.json matching `pattern`
+        std::vector<std::string> loadBattlefields(const std::string &path, const std::string &pattern) {
+            auto input = std::ifstream(path);
+            if (!input.is_open())
+                throw std::runtime_error("Failed to open " + path);
+
+            auto ss = std::stringstream();
+            ss << input.rdbuf();
+            auto stripped = std::stringstream(stripComments(ss.str()));
+
+            auto tree = pt::ptree();
+            pt::read_json(stripped, tree);
+
+            auto re = std::regex(pattern);
+            auto res = std::vector<std::string>();
+            for (auto &[key, _] : tree) {
+                if (pattern.empty() || std::regex_search(key, re))
+                    res.push_back(key);
+            }
+
+            return res;
+        }
+
+        // Mirrors the per-battle rolls of the server ML plugin: heroes and
+        // obstacles change every Nth battle, the rest is rolled each battle.
+        Catalog generate(const Params &p, const std::vector<std::string> &battlefields) {
+            auto catalog = Catalog(p.seed);
+            auto rng = UserAgents::Rng(p.seed, 0);
+            auto chance = [&rng](int percent) { return int(rng.below(100)) < percent; };
+
+            for (auto &bf : battlefields)
+                catalog.addBattlefield(bf);
+
+            uint32_t heroSeed = 0;
+            uint32_t obstacleSeed = 0;
+
+            for (int i=0; i<p.count; i++) {
+                if (p.randomHeroes > 0 && i % p.randomHeroes == 0)
+                    heroSeed = uint32_t(rng.next()) | 1;  // 0 means "map heroes"
+
+                if (p.randomObstacles > 0 && i % p.randomObstacles == 0)
+                    obstacleSeed = uint32_t(rng.next()) | 1;
+
+                auto s = Scenario{};
+                s.battlefield = -1;
+                s.heroSeed = heroSeed;
+                s.obstacleSeed = obstacleSeed;
+                s.mana = p.manaMin + rng.below(p.manaMax - p.manaMin + 1);
+
+                if (chance(p.townChance)) s.flags |= Scenario::TOWN;
+                if (chance(p.warmachineChance)) s.flags |= Scenario::WARMACHINES;
+                if (chance(p.randomStackChance)) s.flags |= Scenario::RANDOM_STACKS;
+                if (chance(p.tightFormationChance)) s.flags |= Scenario::TIGHT_FORMATION;
+                if (p.swapSides > 0 && (i / p.swapSides) % 2 == 1) s.flags |= Scenario::SWAP_SIDES;
+
+                if (!battlefields.empty() && chance(p.randomTerrainChance))
+                    s.battlefield = rng.below(battlefields.size());
+
+                catalog.add(s);
+            }
+
+            return catalog;
+        }
+
+        int main(int argc, char * argv[]) {
+            auto p = Params();
+            auto battlefieldsPath = std::string(VCMI_ROOT_DIR "/config/battlefields.json");
+            auto output = std::string();
+
+            auto opts = po::options_description("Usage: " + std::string(argv[0]) + " [options]\n\nAvailable options", 120);
+            opts.add_options()
+                ("help,h", "Show this help")
+                ("output", po::value<std::string>(&output)->value_name("<FILE>"), "Catalog file to write (required)")
+                ("count", po::value<int>(&p.count)->value_name("<N>"), "Number of scenarios (default 10000)")
+                ("seed", po::value<int64_t>(&p.seed)->value_name("<N>"), "Seed for the generator (default 0)")
+                ("battlefields", po::value<std::string>(&battlefieldsPath)->value_name("<FILE>"), "Path to VCMI's config/battlefields.json")
+                ("random-heroes", po::value<int>(&p.randomHeroes)->value_name("<N>"), "Pick heroes at random each Nth combat (disabled if 0)")
+                ("random-obstacles", po::value<int>(&p.randomObstacles)->value_name("<N>"), "Place obstacles at random each Nth combat (disabled if 0)")
+                ("town-chance", po::value<int>(&p.townChance)->value_name("<N>"), "Percent chance to have the combat in a town")
+                ("warmachine-chance", po::value<int>(&p.warmachineChance)->value_name("<N>"), "Percent chance to add war machines")
+                ("random-stack-chance", po::value<int>(&p.randomStackChance)->value_name("<N>"), "Percent chance to use random stacks")
+                ("tight-formation-chance", po::value<int>(&p.tightFormationChance)->value_name("<N>"), "Percent chance to use tight formation")
+                ("random-terrain-chance", po::value<int>(&p.randomTerrainChance)->value_name("<N>"), "Percent chance to set a random terrain")
+                ("battlefield-pattern", po::value<std::string>(&p.battlefieldPattern)->value_name("<REGEX>"), "Regex for filtering battlefields by json key")
+                ("mana-min", po::value<int>(&p.manaMin)->value_name("<N>"), "Minimum hero mana (default 0)")
+                ("mana-max", po::value<int>(&p.manaMax)->value_name("<N>"), "Maximum hero mana (default 100)")
+                ("swap-sides", po::value<int>(&p.swapSides)->value_name("<N>"), "Swap combat sides each Nth combat (disabled if 0)");
+
+            po::variables_map vm;
+
+            try {
+                po::store(po::command_line_parser(argc, argv).options(opts).run(), vm);
+                po::notify(vm);
+            } catch (const po::error& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                std::cout << opts << "\n";
+                return 1;
+            }
+
+            if (vm.count("help") || output.empty()) {
+                std::cout << opts << "\n";
+                return 1;
+            }
+
+            if (p.count <= 0) {
+                std::cerr << "Bad value for count: expected a positive integer, got: " << p.count << "\n";
+                return 1;
+            }
+
+            for (auto [name, value] : {
+                std::pair{"random-heroes", p.randomHeroes},
+                std::pair{"random-obstacles", p.randomObstacles},
+                std::pair{"swap-sides", p.swapSides}
+            }) {
+                if (value < 0) {
+                    std::cerr << "Bad value for " << name << ": expected a non-negative integer, got: " << value << "\n";
+                    return 1;
+                }
+            }
+
+            for (auto [name, value] : {
+                std::pair{"town-chance", p.townChance},
+                std::pair{"warmachine-chance", p.warmachineChance},
+                std::pair{"random-stack-chance", p.randomStackChance},
+                std::pair{"tight-formation-chance", p.tightFormationChance},
+                std::pair{"random-terrain-chance", p.randomTerrainChance}
+            }) {
+                if (value < 0 || value > 100) {
+                    std::cerr << "Bad value for " << name << ": expected an integer between 0 and 100, got: " << value << "\n";
+                    return 1;
+                }
+            }
+
+            if (p.manaMin < 0 || p.manaMax < p.manaMin || p.manaMax > 500) {
+                std::cerr << "Bad value for mana-min/mana-max: expected 0 <= min <= max <= 500\n";
+                return 1;
+            }
+
+            auto battlefields = std::vector<std::string>();
+            if (p.randomTerrainChance > 0) {
+                battlefields = loadBattlefields(battlefieldsPath, p.battlefieldPattern);
+                if (battlefields.empty()) {
+                    std::cerr << "No battlefields match pattern: " << p.battlefieldPattern << "\n";
+                    return 1;
+                }
+            }
+
+            generate(p, battlefields).save(output);
+            printf("Wrote %d scenarios (%zu battlefields) to %s\n", p.count, battlefields.size(), output.c_str());
+            return 0;
+        }
+    }
+}
+
+int main(int argc, char * argv[]) {
+    return ML::Scenarios::main(argc, argv);
+}
@@ -0,0 +1,301 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+// Merges the per-worker stats shards written with --workers N --stats-shards
+// (see _notes/stats_shards.txt). All shards start as copies of the same base
+// file, so for every row the merged counters are base + sum(shard - base).
+//
+// The schema belongs to the server ML plugin, so it is not hardcoded here:
+// in every table the primary key columns identify a row and the counters
+// are given with --counter (other columns keep the base values).
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include <sqlite3.h>
+
+namespace po = boost::program_options;
+namespace fs = std::filesystem;
+
+namespace ML {
+    namespace Stats {
+        struct Table {
+            std::string name;
+            std::vector<std::string> keys;
+            std::vector<std::string> counters;
+            std::vector<std::string> columns;
+        };
+
+        std::string quote(const std::string &ident) {
+            return "\"" + boost::replace_all_copy(ident, "\"", "\"\"") + "\"";
+        }
+
+        std::string literal(const std::string &str) {
+            return "'" + boost::replace_all_copy(str, "'", "''") + "'";
+        }
+
+        void exec(sqlite3 * db, const std::string &sql) {
+            char * err = nullptr;
+            if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
+                auto msg = std::string(err ? err : sqlite3_errmsg(db));
+                sqlite3_free(err);
+                throw std::runtime_error(msg + "\nSQL: " + sql);
+            }
+        }
+
+        std::vector<std::vector<std::string>> query(sqlite3 * db, const std::string &sql) {
+            sqlite3_stmt * stmt;
+            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+                throw std::runtime_error(std::string(sqlite3_errmsg(db)) + "\nSQL: " + sql);
+
+            auto rows = std::vector<std::vector<std::string>>();
+            int rc;
+
+            while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+                auto &row = rows.emplace_back();
+                for (int i=0; i<sqlite3_column_count(stmt); i++) {
+                    auto text = sqlite3_column_text(stmt, i);
+                    row.push_back(text ? reinterpret_cast<const char*>(text) : "");
+                }
+            }
+
+            sqlite3_finalize(stmt);
+
+            if (rc != SQLITE_DONE)
+                throw std::runtime_error(std::string(sqlite3_errmsg(db)) + "\nSQL: " + sql);
+
+            return rows;
+        }
+
+        bool isNumeric(std::string type) {
+            boost::to_upper(type);
+            for (auto t : {"INT", "REAL", "FLOA", "DOUB", "NUM", "DEC"})
+                if (type.find(t) != std::string::npos)
+                    return true;
+            return false;
+        }
+
+        // `counters` holds TABLE.COLUMN names; each must be a numeric
+        // non-key column
+        std::vector<Table> loadTables(sqlite3 * db, const std::set<std::string> &counters) {
+            auto tables = std::vector<Table>();
+            auto found = std::set<std::string>();
+            auto names = query(db, "SELECT name FROM main.sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%'");
+
+            for (auto &row : names) {
+                auto &table = tables.emplace_back();
+                table.name = row.at(0);
+
+                // cid, name, type, notnull, dflt_value, pk
+                for (auto &col : query(db, "PRAGMA main.table_info(" + quote(table.name) + ")")) {
+                    auto name = table.name + "." + col.at(1);
+                    auto counter = counters.count(name) > 0;
+                    table.columns.push_back(col.at(1));
+
+                    if (col.at(5) != "0") {
+                        if (counter)
+                            throw std::runtime_error("counter " + name + " is a primary key column");
+                        table.keys.push_back(col.at(1));
+                    } else if (counter) {
+                        if (!isNumeric(col.at(2)))
+                            throw std::runtime_error("counter " + name + " is not numeric: " + col.at(2));
+                        table.counters.push_back(col.at(1));
+                        found.insert(name);
+                    }
+                }
+
+                if (table.keys.empty() && !table.counters.empty())
+                    throw std::runtime_error("table " + table.name + " has no primary key");
+            }
+
+            for (auto &name : counters)
+                if (!found.count(name))
+                    throw std::runtime_error("counter not found: " + name);
+
+            return tables;
+        }
+
+        // Adds (shard - base) for every row of `schema` to the matching row in main
+        void mergeTable(sqlite3 * db, const Table &table, const std::string &schema) {
+            if (table.counters.empty())
+                return;
+
+            auto t = quote(table.name);
+            auto match = [&table](const std::string &a, const std::string &b) {
+                auto conds = std::vector<std::string>();
+                for (auto &k : table.keys)
+                    conds.push_back(a + "." + quote(k) + " IS " + b + "." + quote(k));
+                return boost::join(conds, " AND ");
+            };
+
+            // Rows the base does not have: insert them with zeroed counters
+            auto cols = std::vector<std::string>();
+            auto vals = std::vector<std::string>();
+            for (auto &c : table.columns) {
+                auto counter = std::find(table.counters.begin(), table.counters.end(), c) != table.counters.end();
+                cols.push_back(quote(c));
+                vals.push_back(counter ? "0" : "s." + quote(c));
+            }
+
+            exec(db, "INSERT OR IGNORE INTO main." + t + " (" + boost::join(cols, ", ") + ")"
+                " SELECT " + boost::join(vals, ", ") + " FROM " + schema + "." + t + " AS s");
+
+            auto sets = std::vector<std::string>();
+            for (auto &c : table.counters) {
+                auto q = quote(c);
+                sets.push_back(q + " = " + q + " + ("
+                    "SELECT s." + q + " - COALESCE(b." + q + ", 0)"
+                    " FROM " + schema + "." + t + " AS s"
+                    " LEFT JOIN base." + t + " AS b ON " + match("b", "s") +
+                    " WHERE " + match("s", "main." + t) + ")");
+            }
+
+            exec(db, "UPDATE main." + t + " SET " + boost::join(sets, ", ") +
+                " WHERE EXISTS (SELECT 1 FROM " + schema + "." + t + " AS s WHERE " + match("s", "main." + t) + ")");
+        }
+
+        void merge(const std::string &base, const std::vector<std::string> &shards, const std::string &output, const std::set<std::string> &counters) {
+            // Merge into a temporary file first, so `output` may also be `base`
+            auto tmp = output + ".merging";
+            fs::copy_file(base, tmp, fs::copy_options::overwrite_existing);
+
+            sqlite3 * db;
+            if (sqlite3_open(tmp.c_str(), &db) != SQLITE_OK)
+                throw std::runtime_error("could not open " + tmp + ": " + sqlite3_errmsg(db));
+
+            try {
+                exec(db, "ATTACH " + literal(base) + " AS base");
+                auto tables = loadTables(db, counters);
+
+                for (auto &shard : shards) {
+                    printf("Merging %s\n", shard.c_str());
+                    exec(db, "ATTACH " + literal(shard) + " AS shard");
+                    exec(db, "BEGIN");
+                    for (auto &table : tables)
+                        mergeTable(db, table, "shard");
+                    exec(db, "COMMIT");
+                    exec(db, "DETACH shard");
+                }
+            } catch (...) {
+                sqlite3_close(db);
+                fs::remove(tmp);
+                throw;
+            }
+
+            sqlite3_close(db);
+            fs::rename(tmp, output);
+        }
+
+        int main(int argc, char * argv[]) {
+            auto base = std::string();
+            auto output = std::string();
+            auto workers = 0;
+            auto shards = std::vector<std::string>();
+            auto counters = std::vector<std::string>();
+            auto keepShards = false;
+
+            auto opts = po::options_description("Usage: " + std::string(argv[0]) + " [options] [<SHARD>...]\n\nAvailable options", 120);
+            opts.add_options()
+                ("help,h", "Show this help")
+                ("stats-storage", po::value<std::string>(&base)->value_name("<PATH>"), "The --stats-storage the shards were copied from")
+                ("workers", po::value<int>(&workers)->value_name("<N>"), "Merge shards <PATH>.0 ... <PATH>.<N-1>")
+                ("output", po::value<std::string>(&output)->value_name("<PATH>"), "File to write the merged stats to (default: <PATH>)")
+                ("counter", po::value<std::vector<std::string>>(&counters)->value_name("<TABLE.COLUMN>"), "Column to merge as a counter (repeatable); other non-key columns keep the base values")
+                ("keep-shards", po::bool_switch(&keepShards), "Do not delete the shards after merging them")
+                ("shard", po::value<std::vector<std::string>>(&shards)->value_name("<SHARD>"), "Shard file to merge");
+
+            auto pos = po::positional_options_description();
+            pos.add("shard", -1);
+
+            po::variables_map vm;
+
+            try {
+                po::store(po::command_line_parser(argc, argv).options(opts).positional(pos).run(), vm);
+                po::notify(vm);
+            } catch (const po::error& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                std::cout << opts << "\n";
+                return 1;
+            }
+
+            if (vm.count("help")) {
+                std::cout << opts << "\n";
+                return 1;
+            }
+
+            if (base.empty()) {
+                std::cerr << "--stats-storage is required\n";
+                return 1;
+            }
+
+            if (counters.empty()) {
+                std::cerr << "No counters given (use --counter <TABLE.COLUMN>)\n";
+                return 1;
+            }
+
+            if (workers < 0) {
+                std::cerr << "Bad value for workers: expected a non-negative integer, got: " << workers << "\n";
+                return 1;
+            }
+
+            for (int i=0; i<workers; i++)
+                shards.push_back(base + "." + std::to_string(i));
+
+            if (shards.empty()) {
+                std::cerr << "No shards given (use --workers or list them)\n";
+                return 1;
+            }
+
+            for (auto &path : shards) {
+                if (!fs::is_regular_file(path)) {
+                    std::cerr << "Shard not found: " << path << "\n";
+                    return 1;
+                }
+            }
+
+            if (output.empty())
+                output = base;
+
+            try {
+                merge(base, shards, output, std::set<std::string>(counters.begin(), counters.end()));
+            } catch (const std::exception &e) {
+                std::cerr << "Merge failed: " << e.what() << "\n";
+                return 1;
+            }
+
+            printf("Merged %zu shard(s) into %s\n", shards.size(), output.c_str());
+
+            // Merging a shard twice counts its stats twice, and mlclient-cli
+            // refuses to reset shards which are still there
+            if (!keepShards)
+                for (auto &path : shards)
+                    fs::remove(path);
+
+            return 0;
+        }
+    }
+}
+
+int main(int argc, char * argv[]) {
+    return ML::Stats::main(argc, argv);
+}
@@ -0,0 +1,182 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "./agent.h"
+#include "AI/MMAI/common.h"
+
+namespace ML {
+    namespace UserAgents {
+        template <int V>
+        std::string Agent<V>::getName() { return "UserAgent (v" + std::to_string(V) + ")"; };
+
+        template <int V>
+        int Agent<V>::getVersion() { return V; };
+
+        template <int V>
+        double Agent<V>::getValue(const MMAI::Schema::IState * s) { return -666; };
+
+        // The full checks are done on the first step of each battle only
+        template <int V>
+        void Agent<V>::validate(const MMAI::Schema::IState * s) {
+            if (s->version() != V)
+                throw std::runtime_error("Expected version " + std::to_string(V) + ", got: " + std::to_string(s->version()));
+
+            auto any = s->getSupplementaryData();
+            auto err = MMAI::Schema::AnyCastError(any, typeid(const typename SchemaTypes<V>::ISupplementaryData*));
+            ASSERT(err.empty(), "anycast for getSumpplementaryData error: " + err);
+
+            validated = true;
+        }
+
+        template <int V>
+        MMAI::Schema::Action Agent<V>::getAction(const MMAI::Schema::IState * s) {
+            using ISupplementaryData = typename SchemaTypes<V>::ISupplementaryData;
+
+            MMAI::Schema::Action act;
+            auto l = std::lock_guard(mutex);
+
+            if (!validated)
+                validate(s);
+
+            // The data is owned by the state (not stable across steps), so
+            // only the cheap typed cast is done here; see validate()
+            auto any = s->getSupplementaryData();
+            auto psup = std::any_cast<const ISupplementaryData*>(&any);
+            if (!psup)
+                throw std::runtime_error("Unexpected supplementary data type for version " + std::to_string(V));
+
+            auto sup = *psup;
+            auto side = static_cast<int>(sup->getSide());
+
+            if (benchmark)
+                benchmark->beforeAction();
+
+            if (sup->getType() == ISupplementaryData::Type::ANSI_RENDER) {
+                std::cout << sup->getAnsiRender() << "\n";
+                // use stored mask from pre-render result
+                act = interactive
+                    ? promptAction(lastmask[side])
+                    : (replay[side] ? recordedAction(side) : randomValidAction(lastmask[side]));
+
+                stats[side].steps++;
+                render[side] = false;
+            } else if (autorender && !benchmark && !render[side] && (renderSide < 0 || renderSide == side)) {
+                logAi->debug("Side: %d", side);
+                render[side] = true;
+                // store mask of this result for the next action
+                lastmask[side] = s->getActionMask();
+                act = MMAI::Schema::ACTION_RENDER_ANSI;
+            } else if (sup->getIsBattleEnded()) {
+                if (benchmark)
+                    benchmark->onReset();
+
+                if (replay[side])
+                    replay[side].endEpisode();
+
+                stats[side].battles++;
+                validated = false;
+
+                if (!benchmark) logGlobal->debug("user-callback battle ended => sending ACTION_RESET");
+                act = MMAI::Schema::ACTION_RESET;
+            // } else if (false)
+            } else {
+                render[side] = false;
+                act = interactive
+                    ? promptAction(s->getActionMask())
+                    : (replay[side] ? recordedAction(side) : randomValidAction(s->getActionMask()));
+
+                stats[side].steps++;
+            }
+
+            if (verbose && !benchmark) logGlobal->debug("user-callback getAction returning: %d", EI(act));
+            if (benchmark) benchmark->afterAction();
+            return act;
+        };
+
+        template <int V>
+        MMAI::Schema::Action Agent<V>::promptAction(const MMAI::Schema::ActionMask* mask) {
+            int num;
+
+            while (true) {
+                std::cout << "Enter an integer (blank or 0 for a random valid action): ";
+
+                // Read the user input as a string
+                std::string input;
+                std::getline(std::cin, input);
+
+                // If the input is empty, treat it as if 0 was entered
+                if (input.empty()) {
+                    num = 0;
+                    break;
+                } else {
+                    try {
+                        num = std::stoi(input);
+                        if (num >= 0)
+                            break;
+                        else
+                            std::cerr << "Invalid input!\n";
+                    } catch (const std::invalid_argument& e) {
+                        std::cerr << "Invalid input!\n";
+                    } catch (const std::out_of_range& e) {
+                        std::cerr << "Invalid input!\n";
+                    }
+                }
+            }
+
+            return num == 0 ? randomValidAction(mask) : MMAI::Schema::Action(num);
+        }
+
+        template <int V>
+        MMAI::Schema::Action Agent<V>::recordedAction(int side) {
+            return MMAI::Schema::Action(replay[side].next(side));
+        };
+
+        template <int V>
+        MMAI::Schema::Action Agent<V>::firstValidAction(const MMAI::Schema::ActionMask* mask) {
+            for (int j = 1; j < mask->size(); j++)
+                if ((*mask)[j]) return j;
+
+            return -5;
+        }
+
+        //
+        // Registration of all versions in Versions
+        //
+
+        template <int... Vs>
+        std::vector<std::string> versionNames(std::integer_sequence<int, Vs...>) {
+            return {std::to_string(Vs)...};
+        }
+
+        template <int... Vs>
+        Base * makeAgent(std::integer_sequence<int, Vs...>, int version, std::shared_ptr<Benchmark> benchmark, bool interactive, bool autorender, bool verbose, std::shared_ptr<const Replay> replay, int seed, int stream) {
+            Base * res = nullptr;
+            ((version == Vs && (res = new Agent<Vs>(benchmark, interactive, autorender, verbose, replay, seed, stream))) || ...);
+            return res;
+        }
+
+        std::vector<std::string> AgentVersions() {
+            return versionNames(Versions{});
+        }
+
+        Base * MakeAgent(int version, std::shared_ptr<Benchmark> benchmark, bool interactive, bool autorender, bool verbose, std::shared_ptr<const Replay> replay, int seed, int stream) {
+            auto res = makeAgent(Versions{}, version, benchmark, interactive, autorender, verbose, replay, seed, stream);
+            if (!res)
+                throw std::runtime_error("Unsupported user agent version: " + std::to_string(version));
+            return res;
+        }
+    }
+}
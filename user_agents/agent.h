@@ -17,10 +17,16 @@
 #pragma once
 
 #include "./base.h"
+#include "ML/model_wrappers/supplementary.h"
 
 namespace ML {
     namespace UserAgents {
-        class AgentV12 : public Base {
+        // The supported versions are listed in model_wrappers/supplementary.h
+        using ModelWrappers::SchemaTypes;
+        using ModelWrappers::Versions;
+
+        template <int V>
+        class Agent : public Base {
         public:
             using Base::Base;
 
@@ -29,17 +35,28 @@ namespace ML {
             int getAction(const MMAI::Schema::IState * s) override;
             double getValue(const MMAI::Schema::IState * s) override;
         private:
-            unsigned long steps = 0;
-            unsigned long resets = 0;
-            clock_t t0 = 0;
-            bool render = false;
-            const MMAI::Schema::ActionMask* lastmask = nullptr;
-            int recording_i = 0;
+            bool validated = false;  // reset at the end of each battle
+            bool render[2] = {false, false};  // indexed by side
+            const MMAI::Schema::ActionMask* lastmask[2] = {nullptr, nullptr};
 
+            void validate(const MMAI::Schema::IState * s);
             MMAI::Schema::Action promptAction(const MMAI::Schema::ActionMask* mask);
-            MMAI::Schema::Action recordedAction();
-            MMAI::Schema::Action randomValidAction(const MMAI::Schema::ActionMask* mask);
+            MMAI::Schema::Action recordedAction(int side);
             MMAI::Schema::Action firstValidAction(const MMAI::Schema::ActionMask* mask);
         };
+
+        std::vector<std::string> AgentVersions();
+
+        // Same arguments as Base; throws for unsupported versions
+        Base * MakeAgent(
+            int version,
+            std::shared_ptr<Benchmark> benchmark,
+            bool interactive,
+            bool autorender,
+            bool verbose,
+            std::shared_ptr<const Replay> replay,
+            int seed,
+            int stream
+        );
     }
 }
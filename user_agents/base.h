@@ -16,18 +16,45 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <random>
+
 #include "AI/MMAI/schema/base.h"
+#include "./benchmark.h"
+#include "./replay.h"
+#include "./sampler.h"
 
 namespace ML {
     namespace UserAgents {
         class Base : public MMAI::Schema::IModel {
         public:
-            Base(bool benchmark_, bool interactive_, bool autorender_, bool verbose_, std::vector<int> actions_)
-            : benchmark(benchmark_)
+            // A zero seed means a random (non-reproducible) seed.
+            // Agents with the same seed but different streams (e.g. the two
+            // sides) pick independent actions.
+            Base(std::shared_ptr<Benchmark> benchmark_, bool interactive_, bool autorender_, bool verbose_, std::shared_ptr<const Replay> replay_, int seed_, int stream_)
+            : autorender(autorender_)
+            , benchmark(benchmark_)
             , interactive(interactive_)
-            , autorender(autorender_)
             , verbose(verbose_)
-            , actions(actions_) {};
+            , replay{replay_, replay_}
+            , sampler(seed_ ? seed_ : std::random_device()(), stream_) {};
+
+            // An agent may serve both sides (self-play), so these are per side
+            struct SideStats {
+                unsigned long steps = 0;
+                unsigned long battles = 0;
+            };
+
+            void reseed(int seed, int stream) {
+                sampler.reseed(seed ? seed : std::random_device()(), stream);
+            }
+
+            // With autorender, render only the steps of `side` (e.g. in
+            // self-play, where one agent serves both sides)
+            void setRenderSide(int side) {
+                renderSide = side;
+            }
 
             MMAI::Schema::ModelType getType() override { return MMAI::Schema::ModelType::USER; };
             std::string getName() override { return ""; };
@@ -35,12 +62,33 @@ namespace ML {
             int getAction(const MMAI::Schema::IState * s) override { return 0; };
             double getValue(const MMAI::Schema::IState * s) override { return 0; };
             MMAI::Schema::Side getSide() override { return MMAI::Schema::Side::BOTH; };
+
+            const SideStats & getStats(int side) const { return stats[side]; }
         protected:
             const bool autorender;
-            const bool benchmark;  // obsoletes all options below, always picks random actions
+            const std::shared_ptr<Benchmark> benchmark;  // if set, obsoletes all options below, always picks random actions
             const bool interactive;
             const bool verbose;
-            const std::vector<int> actions;
+            ReplayCursor replay[2];  // indexed by side
+            Sampler sampler;
+            SideStats stats[2];
+            int renderSide = -1;     // -1 for both
+
+            // Both sides of a self-play agent may be asked for actions from
+            // different threads (e.g. both get the final state at battle end)
+            std::mutex mutex;
+
+            MMAI::Schema::Action randomValidAction(const MMAI::Schema::ActionMask* mask) {
+                // action 0 is never valid
+                auto action = sampler.uniform(*mask, 1);
+
+                if (action < 0) {
+                    logAi->info("No valid actions => reset");
+                    return MMAI::Schema::ACTION_RESET;
+                }
+
+                return action;
+            }
         };
     }
 }
@@ -0,0 +1,176 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "./benchmark.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace ML {
+    namespace UserAgents {
+        std::atomic<bool> Benchmark::CountAllocations = false;
+        std::atomic<unsigned long> Benchmark::Allocations = 0;
+
+        void Benchmark::Histogram::add(double us) {
+            auto i = us > 0 ? size_t(std::log1p(us) / std::log(GROWTH)) : 0;
+            counts[std::min(i, SIZE - 1)]++;
+            n++;
+            sum += us;
+            max = std::max(max, us);
+        }
+
+        Benchmark::Percentiles Benchmark::Histogram::compute() const {
+            if (n == 0)
+                return {0, 0, 0, 0, 0};
+
+            // the middle of the bucket holding the q-th value
+            auto at = [this](double q) {
+                auto rank = static_cast<unsigned long>(q * (n - 1)) + 1;
+                unsigned long seen = 0;
+                for (size_t i=0; i<SIZE; i++) {
+                    seen += counts[i];
+                    if (seen >= rank)
+                        return std::min(std::expm1((i + 0.5) * std::log(GROWTH)), max);
+                }
+                return max;
+            };
+
+            return {sum / n, at(0.5), at(0.9), at(0.99), max};
+        }
+
+        Benchmark::Benchmark(unsigned long warmupSteps, std::string output)
+        : warmupSteps(warmupSteps)
+        , output(output)
+        , tCreated(Clock::now()) {
+            CountAllocations.store(true, std::memory_order_relaxed);
+        };
+
+        void Benchmark::setWorker(int worker) {
+            auto l = std::lock_guard(mutex);
+            if (!output.empty())
+                output += "." + std::to_string(worker);
+        }
+
+        void Benchmark::beforeAction() {
+            auto l = std::lock_guard(mutex);
+            tBefore = Clock::now();
+            totalSteps++;
+
+            if (totalSteps == 1)
+                tFirst = tBefore;
+
+            if (totalSteps <= warmupSteps)
+                return;
+
+            if (totalSteps == warmupSteps + 1) {
+                t0 = tBefore;
+                allocations0 = Allocations.load(std::memory_order_relaxed);
+                tReport = tBefore;
+                return;
+            }
+
+            otherTimes.add(std::chrono::duration<double, std::micro>(tBefore - tAfter).count());
+        }
+
+        void Benchmark::afterAction() {
+            auto l = std::lock_guard(mutex);
+            tAfter = Clock::now();
+
+            if (totalSteps <= warmupSteps)
+                return;
+
+            agentTimes.add(std::chrono::duration<double, std::micro>(tAfter - tBefore).count());
+            allocations1 = Allocations.load(std::memory_order_relaxed);
+            steps++;
+            reportSteps++;
+        }
+
+        void Benchmark::onReset() {
+            auto l = std::lock_guard(mutex);
+            if (totalSteps <= warmupSteps)
+                return;
+
+            resets++;
+            reportResets++;
+
+            switch (resets % 4) {
+            case 0: printf("\r|"); break;
+            case 1: printf("\r\\"); break;
+            case 2: printf("\r-"); break;
+            case 3: printf("\r/"); break;
+            }
+
+            if (reportResets == 10) {
+                auto now = Clock::now();
+                auto s = std::chrono::duration<double>(now - tReport).count();
+                printf("  steps/s: %-6.0f resets/s: %-6.2f\n", reportSteps/s, reportResets/s);
+                reportSteps = 0;
+                reportResets = 0;
+                tReport = now;
+            }
+
+            fflush(stdout);
+        }
+
+        void Benchmark::summary() {
+            auto l = std::lock_guard(mutex);
+
+            try {
+                writeSummary();
+            } catch (const std::exception &e) {
+                fprintf(stderr, "Failed to write the benchmark summary: %s\n", e.what());
+            }
+        }
+
+        // Must be called with the mutex held
+        void Benchmark::writeSummary() {
+            auto seconds = steps > 0 ? std::chrono::duration<double>(tAfter - t0).count() : 0.0;
+            auto startup = totalSteps > 0 ? std::chrono::duration<double>(tFirst - tCreated).count() : 0.0;
+            auto allocs = steps > 0 ? double(allocations1 - allocations0) / steps : 0.0;
+            auto agent = agentTimes.compute();
+            auto other = otherTimes.compute();
+
+            FILE * f = output.empty() ? stderr : fopen(output.c_str(), "w");
+            if (!f)
+                throw std::runtime_error("failed to open " + output + ": " + strerror(errno));
+
+            auto pct = [f](const char * name, const Percentiles &p, const char * sep) {
+                fprintf(f, "  \"%s\": {\"mean\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f}%s\n",
+                    name, p.mean, p.p50, p.p90, p.p99, p.max, sep);
+            };
+
+            fprintf(f, "{\n");
+            fprintf(f, "  \"startup_seconds\": %.3f,\n", startup);
+            fprintf(f, "  \"warmup_steps\": %lu,\n", warmupSteps);
+            fprintf(f, "  \"steps\": %lu,\n", steps);
+            fprintf(f, "  \"resets\": %lu,\n", resets);
+            fprintf(f, "  \"seconds\": %.3f,\n", seconds);
+            fprintf(f, "  \"steps_per_sec\": %.2f,\n", seconds > 0 ? steps / seconds : 0);
+            fprintf(f, "  \"resets_per_sec\": %.3f,\n", seconds > 0 ? resets / seconds : 0);
+            fprintf(f, "  \"allocations_per_step\": %.2f,\n", allocs);
+            pct("agent_us", agent, ",");
+            pct("other_us", other, "");
+            fprintf(f, "}\n");
+
+            if (f != stderr && fclose(f) != 0)
+                throw std::runtime_error("failed to write " + output + ": " + strerror(errno));
+        }
+    }
+}
@@ -0,0 +1,104 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+namespace ML {
+    namespace UserAgents {
+        // Wall-clock throughput and latency measurements for user agents.
+        // Agents call beforeAction()/afterAction() around each getAction:
+        // the time in between is "agent" time, the time from one step's
+        // afterAction() to the next step's beforeAction() is "other" time:
+        // the engine, the client/server round-trip and, when both sides
+        // are measured, the opponent's decision.
+        // A single instance may be shared by both sides' agents (calls are
+        // serialized by a mutex).
+        class Benchmark {
+        public:
+            Benchmark(unsigned long warmupSteps, std::string output);
+
+            void beforeAction();
+            void afterAction();
+            void onReset();
+
+            // Makes summary() write to `<output>.<worker>` (call in the worker)
+            void setWorker(int worker);
+
+            // Writes a JSON summary to `output` (or stderr if it is empty,
+            // where it is not mixed with the logs and progress on stdout).
+            // Does not throw (it runs at exit); errors go to stderr.
+            void summary();
+
+            // Incremented by the global operator new (see main.cpp) once
+            // CountAllocations is set, i.e. after a Benchmark is created
+            static std::atomic<bool> CountAllocations;
+            static std::atomic<unsigned long> Allocations;
+        private:
+            using Clock = std::chrono::steady_clock;
+
+            struct Percentiles {
+                double mean, p50, p90, p99, max;
+            };
+
+            // Fixed memory latency histogram: log-spaced buckets, ~2% wide
+            struct Histogram {
+                static constexpr double GROWTH = 1.02;
+                static constexpr size_t SIZE = 1024;  // up to ~10 min
+
+                std::array<unsigned long, SIZE> counts = {};
+                unsigned long n = 0;
+                double sum = 0;
+                double max = 0;
+
+                void add(double us);
+                Percentiles compute() const;
+            };
+
+            const unsigned long warmupSteps;
+            std::string output;
+            std::mutex mutex;
+
+            unsigned long steps = 0;
+            unsigned long resets = 0;
+            unsigned long totalSteps = 0;
+
+            // progress report every 10 resets
+            unsigned long reportSteps = 0;
+            unsigned long reportResets = 0;
+            Clock::time_point tReport;
+
+            Clock::time_point tCreated;
+            Clock::time_point tFirst;
+            Clock::time_point t0;
+            unsigned long allocations0 = 0;
+            unsigned long allocations1 = 0;
+            Clock::time_point tBefore;
+            Clock::time_point tAfter;
+
+            // in microseconds
+            Histogram agentTimes;
+            Histogram otherTimes;
+
+            void writeSummary();
+        };
+    }
+}
@@ -0,0 +1,240 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "./replay.h"
+#include "ML/model_wrappers/recorder.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ACTION_RESET in the schema
+constexpr int REPLAY_EPISODE_END = -1;
+
+namespace ML {
+    namespace UserAgents {
+        std::shared_ptr<Replay> Replay::Load(std::string path) {
+            auto res = std::shared_ptr<Replay>(new Replay());
+
+            if (path.size() >= 4 && path.substr(path.size() - 4) == ".txt") {
+                std::ifstream input(path);
+                if (!input.is_open())
+                    throw std::runtime_error("Failed to open " + path);
+
+                res->header.magic = ReplayHeader::MAGIC;
+                res->header.version = ReplayHeader::VERSION;
+
+                int num;
+                while (input >> num) {
+                    if (num == REPLAY_EPISODE_END)
+                        res->endEpisode();
+                    else
+                        res->add(num);
+                }
+
+                res->endEpisode();
+                return res;
+            }
+
+            if (path.size() >= 5 && path.substr(path.size() - 5) == ".traj") {
+                auto reader = ModelWrappers::TrajectoryReader(path);
+                auto &th = reader.getHeader();
+                auto side = uint8_t(th.side);
+
+                res->header.magic = ReplayHeader::MAGIC;
+                res->header.version = ReplayHeader::VERSION;
+
+                // see the record layout in recorder.h
+                auto actionOffset = th.obsSize * sizeof(float) + (th.maskSize + 7) / 8;
+                auto doneOffset = actionOffset + sizeof(int32_t) + sizeof(float);
+
+                for (uint64_t i=0; i<reader.size(); i++) {
+                    auto rec = reader.record(i);
+                    if (rec[doneOffset]) {
+                        res->endEpisode(side);
+                        continue;
+                    }
+
+                    int32_t action;
+                    std::memcpy(&action, rec + actionOffset, sizeof(action));
+                    res->add(action);
+                }
+
+                // a battle cut short by the end of the recording
+                res->endEpisode(side);
+                return res;
+            }
+
+            auto fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("Failed to open " + path + ": " + strerror(errno));
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                throw std::runtime_error("Failed to stat " + path + ": " + strerror(errno));
+            }
+
+            res->bytes = st.st_size;
+
+            if (res->bytes < sizeof(ReplayHeader)) {
+                close(fd);
+                throw std::runtime_error("Not a replay file: " + path);
+            }
+
+            auto ptr = mmap(nullptr, res->bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+
+            if (ptr == MAP_FAILED)
+                throw std::runtime_error("mmap failed for " + path + ": " + strerror(errno));
+
+            res->mapped = ptr;
+            std::memcpy(&res->header, ptr, sizeof(ReplayHeader));
+
+            if (res->header.magic != ReplayHeader::MAGIC || res->header.version != ReplayHeader::VERSION)
+                throw std::runtime_error("Not a replay file (or unsupported version): " + path);
+
+            auto tableBytes = uint64_t(res->header.nepisodes) * sizeof(ReplayEpisode);
+            if (tableBytes > res->bytes - sizeof(ReplayHeader))
+                throw std::runtime_error("Corrupt replay file: " + path + " (episode table exceeds the file)");
+
+            auto base = static_cast<const uint8_t*>(ptr);
+            res->episodes = reinterpret_cast<const ReplayEpisode*>(base + sizeof(ReplayHeader));
+            res->actionsData = reinterpret_cast<const int32_t*>(res->episodes + res->header.nepisodes);
+
+            auto nactions = (res->bytes - (reinterpret_cast<const uint8_t*>(res->actionsData) - base)) / sizeof(int32_t);
+            for (uint32_t i=0; i<res->header.nepisodes; i++) {
+                if (res->episodes[i].offset > nactions || res->episodes[i].count > nactions - res->episodes[i].offset)
+                    throw std::runtime_error("Corrupt replay file: " + path + " (episode " + std::to_string(i) + ")");
+            }
+
+            return res;
+        }
+
+        Replay::Replay(int64_t seed) {
+            header.magic = ReplayHeader::MAGIC;
+            header.version = ReplayHeader::VERSION;
+            header.seed = seed;
+        }
+
+        Replay::~Replay() {
+            if (mapped)
+                munmap(mapped, bytes);
+        }
+
+        void Replay::add(int action) {
+            if (mapped)
+                throw std::runtime_error("Replay: cannot modify a mapped replay");
+
+            ownActions.push_back(action);
+            actionsData = ownActions.data();
+        }
+
+        void Replay::endEpisode(uint8_t side) {
+            if (mapped)
+                throw std::runtime_error("Replay: cannot modify a mapped replay");
+
+            // skip empty episodes (e.g. a trailing ACTION_RESET)
+            if (ownActions.size() == episodeStart)
+                return;
+
+            ownEpisodes.push_back({episodeStart, uint32_t(ownActions.size() - episodeStart), side, {}});
+            episodeStart = ownActions.size();
+            episodes = ownEpisodes.data();
+            header.nepisodes = ownEpisodes.size();
+        }
+
+        void Replay::save(std::string path) const {
+            auto f = fopen(path.c_str(), "wb");
+            if (!f)
+                throw std::runtime_error("Failed to open " + path + ": " + strerror(errno));
+
+            auto nactions = size() > 0 ? episodes[size()-1].offset + episodes[size()-1].count : 0;
+            auto ok = fwrite(&header, sizeof(header), 1, f) == 1
+                && fwrite(episodes, sizeof(ReplayEpisode), size(), f) == size()
+                && fwrite(actionsData, sizeof(int32_t), nactions, f) == nactions;
+
+            if (fclose(f) != 0 || !ok)
+                throw std::runtime_error("Failed to write " + path + ": " + strerror(errno));
+        }
+
+        int64_t Replay::getSeed() const {
+            return header.seed;
+        }
+
+        void Replay::setSeed(int64_t seed) {
+            header.seed = seed;
+        }
+
+        uint32_t Replay::size() const {
+            return header.nepisodes;
+        }
+
+        const ReplayEpisode & Replay::episode(uint32_t i) const {
+            return episodes[i];
+        }
+
+        const int32_t * Replay::actions() const {
+            return actionsData;
+        }
+
+        //
+        // ReplayCursor
+        //
+
+        ReplayCursor::ReplayCursor(std::shared_ptr<const Replay> replay)
+        : replay(replay) {};
+
+        ReplayCursor::operator bool() const {
+            return replay != nullptr;
+        }
+
+        int ReplayCursor::next(int side) {
+            if (!active) {
+                auto n = replay->size();
+
+                for (uint32_t j=1; j<=n; j++) {
+                    auto candidate = (episode + j) % n;
+                    auto epside = replay->episode(candidate).side;
+                    if (epside == ReplayEpisode::ANY_SIDE || epside == side) {
+                        episode = candidate;
+                        active = true;
+                        i = 0;
+                        break;
+                    }
+                }
+
+                if (!active)
+                    throw std::runtime_error("\n\n*** No recorded episodes for side " + std::to_string(side) + " ***\n\n");
+            }
+
+            auto &ep = replay->episode(episode);
+            if (i >= ep.count)
+                throw std::runtime_error("\n\n*** No more recorded actions in episode " + std::to_string(episode) + " ***\n\n");
+
+            return replay->actions()[ep.offset + i++];
+        }
+
+        void ReplayCursor::endEpisode() {
+            active = false;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ML {
+    namespace UserAgents {
+        // Replay file format (all integers little-endian):
+        //
+        //   ReplayHeader | ReplayEpisode[nepisodes] | int32 actions[]
+        //
+        // Each episode refers to a range of the actions array.
+        struct ReplayHeader {
+            static constexpr uint32_t MAGIC = 0x50524d4d; // "MMRP"
+            static constexpr uint32_t VERSION = 1;
+
+            uint32_t magic;
+            uint32_t version;
+            int64_t seed;        // the --seed the actions were recorded with (0 if unknown)
+            uint32_t nepisodes;
+            uint32_t reserved;
+        };
+
+        struct ReplayEpisode {
+            static constexpr uint8_t ANY_SIDE = 0xff;
+
+            uint64_t offset;     // index of the first action
+            uint32_t count;
+            uint8_t side;        // MMAI::Schema::Side or ANY_SIDE
+            uint8_t reserved[3];
+        };
+
+        // Recorded actions grouped into episodes (one per battle).
+        // Binary files are memory-mapped. Text files (whitespace-separated
+        // integers, ACTION_RESET ending an episode) and trajectories made
+        // by --record (.traj, one episode per battle, with its side) are
+        // loaded into memory.
+        class Replay {
+        public:
+            static std::shared_ptr<Replay> Load(std::string path);
+
+            Replay(int64_t seed);  // empty, for building with add/endEpisode
+            ~Replay();
+
+            void add(int action);
+            void endEpisode(uint8_t side = ReplayEpisode::ANY_SIDE);
+            void save(std::string path) const;
+
+            int64_t getSeed() const;
+            void setSeed(int64_t seed);
+            uint32_t size() const;
+            const ReplayEpisode & episode(uint32_t i) const;
+            const int32_t * actions() const;
+        private:
+            Replay() = default;
+
+            ReplayHeader header = {};
+            const ReplayEpisode * episodes = nullptr;
+            const int32_t * actionsData = nullptr;
+
+            // mmap-ed file
+            void * mapped = nullptr;
+            size_t bytes = 0;
+
+            // in-memory
+            std::vector<ReplayEpisode> ownEpisodes;
+            std::vector<int32_t> ownActions;
+            uint64_t episodeStart = 0;
+        };
+
+        // Per-agent position in a (shared) replay. Episodes recorded for the
+        // other side are skipped; after the last episode it starts over.
+        class ReplayCursor {
+        public:
+            ReplayCursor(std::shared_ptr<const Replay> replay);
+
+            explicit operator bool() const;
+            int next(int side);
+            void endEpisode();
+        private:
+            const std::shared_ptr<const Replay> replay;
+            int64_t episode = -1;   // index of the last started episode
+            bool active = false;
+            uint32_t i = 0;         // within the active episode
+        };
+    }
+}
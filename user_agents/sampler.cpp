@@ -0,0 +1,152 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#include "./sampler.h"
+
+#include <algorithm>
+
+namespace ML {
+    namespace UserAgents {
+        namespace {
+            uint64_t splitmix64(uint64_t &x) {
+                uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                return z ^ (z >> 31);
+            }
+
+            uint64_t rotl(uint64_t x, int k) {
+                return (x << k) | (x >> (64 - k));
+            }
+
+            // 64x64 => 128-bit product, returns the high half
+            uint64_t mul128(uint64_t a, uint64_t b, uint64_t &low) {
+                uint64_t a0 = uint32_t(a), a1 = a >> 32;
+                uint64_t b0 = uint32_t(b), b1 = b >> 32;
+                uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+                uint64_t mid = (p00 >> 32) + uint32_t(p01) + uint32_t(p10);
+                low = (mid << 32) | uint32_t(p00);
+                return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+            }
+
+            // Position of the n-th set bit of a word (n < popcount(w))
+            int selectInWord(uint64_t w, int n) {
+                for (int i=0; i<n; i++)
+                    w &= w - 1;
+                return __builtin_ctzll(w);
+            }
+        }
+
+        //
+        // Rng
+        //
+
+        Rng::Rng(uint64_t seed, uint64_t stream) {
+            uint64_t x = seed ^ (stream * 0xd1342543de82ef95ULL);
+            for (auto &word : s)
+                word = splitmix64(x);
+        }
+
+        uint64_t Rng::next() {
+            auto result = rotl(s[1] * 5, 7) * 9;
+            auto t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+            return result;
+        }
+
+        // Lemire's nearly divisionless method
+        uint64_t Rng::below(uint64_t n) {
+            uint64_t low;
+            auto high = mul128(next(), n, low);
+
+            if (low < n) {
+                auto threshold = -n % n;
+                while (low < threshold)
+                    high = mul128(next(), n, low);
+            }
+
+            return high;
+        }
+
+        //
+        // PackedMask
+        //
+
+        // std::vector<bool> has no portable access to its words, so this
+        // still reads one bit per action; the saving is in count/select
+        void PackedMask::pack(const MMAI::Schema::ActionMask &mask, int from) {
+            size = mask.size();
+            auto nwords = (size + 63) / 64;
+            auto start = size_t(from);
+
+            if (words.size() < nwords)
+                words.resize(nwords);
+
+            for (size_t w=0; w<nwords; w++) {
+                uint64_t word = 0;
+                auto end = std::min<size_t>(64, size - w*64);
+                for (size_t b=0; b<end; b++)
+                    word |= uint64_t(mask[w*64 + b]) << b;
+                words[w] = word;
+            }
+
+            // clear the bits below `from`
+            for (size_t w=0; w<nwords && w*64 < start; w++)
+                words[w] &= (start - w*64 >= 64) ? 0 : ~((1ULL << (start - w*64)) - 1);
+        }
+
+        int PackedMask::count() const {
+            auto nwords = (size + 63) / 64;
+            int res = 0;
+            for (size_t w=0; w<nwords; w++)
+                res += __builtin_popcountll(words[w]);
+            return res;
+        }
+
+        int PackedMask::select(int n) const {
+            auto nwords = (size + 63) / 64;
+            for (size_t w=0; w<nwords; w++) {
+                auto c = __builtin_popcountll(words[w]);
+                if (n < c)
+                    return int(w*64) + selectInWord(words[w], n);
+                n -= c;
+            }
+            return -1;
+        }
+
+        //
+        // Sampler
+        //
+
+        Sampler::Sampler(uint64_t seed, uint64_t stream)
+        : rng(seed, stream) {};
+
+        void Sampler::reseed(uint64_t seed, uint64_t stream) {
+            rng = Rng(seed, stream);
+        }
+
+        int Sampler::uniform(const MMAI::Schema::ActionMask &mask, int from) {
+            packed.pack(mask, from);
+            auto n = packed.count();
+            return n == 0 ? -1 : packed.select(rng.below(n));
+        }
+    }
+}
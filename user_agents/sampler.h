@@ -0,0 +1,65 @@
+// =============================================================================
+// Copyright 2024 Simeon Manolov <s.manolloff@gmail.com>.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =============================================================================
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AI/MMAI/schema/base.h"
+
+namespace ML {
+    namespace UserAgents {
+        // xoshiro256** seeded via splitmix64 from (seed, stream), so that
+        // each environment/side gets its own reproducible sequence
+        class Rng {
+        public:
+            Rng(uint64_t seed, uint64_t stream);
+
+            uint64_t next();
+            uint64_t below(uint64_t n);  // uniform in [0, n)
+        private:
+            uint64_t s[4];
+        };
+
+        // Action mask packed into 64-bit words (bit i = action i)
+        class PackedMask {
+        public:
+            void pack(const MMAI::Schema::ActionMask &mask, int from);
+
+            int count() const;
+            int select(int n) const;  // index of the n-th set bit (0-based)
+        private:
+            std::vector<uint64_t> words;  // grown once, then reused
+            size_t size = 0;
+        };
+
+        // Allocation-free sampling of valid actions (after the first call,
+        // which sizes the packed mask buffer)
+        class Sampler {
+        public:
+            Sampler(uint64_t seed, uint64_t stream);
+
+            void reseed(uint64_t seed, uint64_t stream);
+
+            // Return -1 if no action in [from, mask.size()) is valid
+            int uniform(const MMAI::Schema::ActionMask &mask, int from = 0);
+        private:
+            Rng rng;
+            PackedMask packed;
+        };
+    }
+}